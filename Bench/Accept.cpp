@@ -0,0 +1,134 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../Server/Server.hpp"
+#include "../Server/Endpoint.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	// Per accepted socket: what a session did before the Endpoint (getpeername, then text "IP:PORT")
+	std::string PeerFromKernel(int fd)
+	{
+		struct sockaddr_storage addr {};
+		socklen_t len = sizeof(addr);
+		getpeername(fd, (struct sockaddr*)&addr, &len);
+
+		char ip[INET6_ADDRSTRLEN];
+		uint16_t port = 0;
+
+		if (addr.ss_family == AF_INET)
+		{
+			auto* s = (struct sockaddr_in*)&addr;
+			port = ntohs(s->sin_port);
+			inet_ntop(AF_INET, &s->sin_addr, ip, sizeof(ip));
+		}
+		else
+		{
+			auto* s = (struct sockaddr_in6*)&addr;
+			port = ntohs(s->sin6_port);
+			inet_ntop(AF_INET6, &s->sin6_addr, ip, sizeof(ip));
+		}
+
+		return std::string(ip) + ':' + std::to_string(port);
+	}
+
+	// ns per call of fn over iterations
+	template <typename Fn>
+	double Measure(size_t iterations, Fn fn)
+	{
+		const Bench::Clock::time_point start = Bench::Clock::now();
+
+		for (size_t i = 0; i < iterations; i++)
+			fn();
+
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now() - start).count()) / static_cast<double>(iterations);
+	}
+}
+
+int Bench::Accept(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbWorkers = static_cast<size_t>(Option(argc, argv, "--workers", 2));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 32));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 3000));
+
+	Target target;
+	if (Resolve("127.0.0.1", port, &target) < 0)
+		return EXIT_FAILURE;
+
+	// ================== Peer of an accepted socket ==================
+	{
+		int listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		struct sockaddr_in6 addr {};
+		addr.sin6_family = AF_INET6;
+		addr.sin6_addr = in6addr_loopback;
+
+		socklen_t len = sizeof(addr);
+		bind(listenFd, (struct sockaddr*)&addr, len);
+		listen(listenFd, 1);
+		getsockname(listenFd, (struct sockaddr*)&addr, &len);
+
+		Target local;
+		std::memcpy(&local.addr, &addr, len);
+		local.len = len;
+
+		int client = Connect(local);
+		struct sockaddr_storage peer {};
+		socklen_t peerLen = sizeof(peer);
+		int fd = accept4(listenFd, (struct sockaddr*)&peer, &peerLen, SOCK_CLOEXEC);
+
+		const size_t iterations = 1000000;
+		// Written by every call so the compiler keeps them
+		volatile size_t sink = 0;
+
+		const double kernel = Measure(iterations, [&]() { sink = PeerFromKernel(fd).size(); });
+		const double endpoint = Measure(iterations, [&]() { sink = Endpoint::FromSockaddr((struct sockaddr*)&peer, peerLen).GetPort(); });
+
+		char text[Endpoint::FORMAT_MAX];
+		const double format = Measure(iterations, [&]() { sink = Endpoint::FromSockaddr((struct sockaddr*)&peer, peerLen).Format(text, sizeof(text)); });
+
+		Out() << "[BENCH] : Peer of an accepted socket" << std::endl;
+		Out() << "  getpeername + std::string: " << kernel << " ns" << std::endl;
+		Out() << "  Endpoint from accept4: " << endpoint << " ns, formatted on demand: " << format << " ns" << std::endl;
+
+		close(fd);
+		close(client);
+		close(listenFd);
+	}
+
+	// ================== Connection churn ==================
+	Server server(port, nbWorkers);
+
+	if (server.Start() < 0)
+		return EXIT_FAILURE;
+
+	Out() << "[BENCH] : Churn, " << nbClients << " clients, " << nbWorkers << " workers for " << duration.count() << " ms" << std::endl;
+
+	Load load;
+	load.Start(target, nbClients);
+	std::this_thread::sleep_for(duration);
+
+	Samples samples;
+	size_t failed = 0;
+
+	for (const auto& result : load.Stop())
+	{
+		if (result.latency < 0)
+			failed++;
+		else
+			samples.Add(result.latency);
+	}
+
+	server.Stop();
+
+	Out() << "  refused/dropped: " << failed << ", accepted sessions/s: " << samples.Count() * 1000 / static_cast<size_t>(duration.count()) << std::endl;
+	Report("connect to reply", samples);
+
+	return EXIT_SUCCESS;
+}
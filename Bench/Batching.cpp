@@ -0,0 +1,268 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "../Server/Session.hpp"
+#include "../Server/Broadcaster.hpp"
+#include "../Server/BatchFlusher.hpp"
+#include "../Server/SessionRegistry.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	int64_t SteadyNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now().time_since_epoch()).count();
+	}
+
+	// Read the strings until the session ends, true if one of them is expected
+	bool Receives(int fd, const std::string& expected)
+	{
+		std::string str;
+		bool found = false;
+
+		while (Bench::RecvString(fd, &str))
+			found = found || str == expected;
+
+		return found;
+	}
+
+	// Broadcasts fill the socket, the handler replies & the flusher finds the socket full (EAGAIN),
+	// then one CoalesceLatest broadcast: the sealed reply must still reach the client
+	bool ReplyKept()
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return false;
+
+		Session::Batching batching;
+		batching.budget = std::chrono::microseconds(50);
+
+		bool kept = false;
+		{
+			Session session(fds[0], Endpoint{}, 0, nullptr, nullptr, batching);
+			const SharedFrame broadcast = Broadcaster::Frame(std::string(64 * 1024, 'b'));
+
+			for (size_t i = 0; i < 64; i++)
+				session.Enqueue(broadcast, 1024, Session::OverflowPolicy::Drop);
+
+			session.SendString("REPLY");
+			session.FlushExpired(INT64_MAX);
+			session.Enqueue(Broadcaster::Frame("latest"), 4, Session::OverflowPolicy::CoalesceLatest);
+
+			std::thread client([&kept, fd = fds[1]]() { kept = Receives(fd, "REPLY"); });
+			session.Flush();
+			session.Shutdown();
+			client.join();
+		}
+
+		close(fds[1]);
+		return kept;
+	}
+
+	// The socket holds 2 broadcasts, the handler queues 3 replies it could not send:
+	// a Drop broadcast with maxQueued 4 must still be queued, the replies take no room
+	bool RepliesNotCounted()
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return false;
+
+		Session::Batching batching;
+		batching.budget = std::chrono::microseconds(50);
+
+		bool queued = false;
+		{
+			Session session(fds[0], Endpoint{}, 0, nullptr, nullptr, batching);
+			const SharedFrame broadcast = Broadcaster::Frame(std::string(1024 * 1024, 'b'));
+
+			for (size_t i = 0; i < 2; i++)
+				session.Enqueue(broadcast, 4, Session::OverflowPolicy::Drop);
+
+			for (size_t i = 0; i < 3; i++)
+			{
+				session.SendString("REPLY");
+				session.FlushExpired(INT64_MAX);
+			}
+
+			queued = session.Enqueue(broadcast, 4, Session::OverflowPolicy::Drop);
+
+			std::thread client([fd = fds[1]]() { Receives(fd, ""); });
+			session.Flush();
+			session.Shutdown();
+			client.join();
+		}
+
+		close(fds[1]);
+		return queued;
+	}
+
+	// The handler writes bursts of 8 stamps (8 B each) then pauses, the client measures how late they arrive
+	// Return false if the socketpair could not be created
+	bool Stream(std::chrono::microseconds budget, std::chrono::milliseconds duration, Bench::Samples* latencies, Session::Stats* stats)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return false;
+
+		Session::Batching batching;
+		batching.budget = budget;
+
+		SessionRegistry registry;
+		BatchFlusher flusher(&registry);
+		flusher.Start();
+
+		{
+			Session session(fds[0], Endpoint{}, 0, nullptr, nullptr, batching);
+			registry.Register(1, &session);
+			session.Attach(1, &flusher, nullptr);
+
+			std::thread client([latencies, fd = fds[1]]() {
+				std::vector<int64_t> values;
+				int64_t stamp;
+
+				while (recv(fd, &stamp, sizeof(stamp), MSG_WAITALL) == static_cast<ssize_t>(sizeof(stamp)))
+					values.push_back((SteadyNs() - stamp) / 1000);
+
+				latencies->Add(values);
+			});
+
+			const Bench::Clock::time_point start = Bench::Clock::now();
+
+			while (Bench::Clock::now() - start < duration)
+			{
+				for (size_t i = 0; i < 8; i++)
+				{
+					const int64_t stamp = SteadyNs();
+					session.SendData(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+				}
+
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+			}
+
+			session.Flush();
+			*stats = session.GetStats();
+
+			session.Shutdown();
+			client.join();
+			registry.Unregister(1);
+		}
+
+		flusher.Stop();
+		close(fds[1]);
+		return true;
+	}
+
+	// A small write then a 1 MiB string, whose header goes in the batch & body after it:
+	// both writes are in the one batch sent
+	Session::Stats LargeCounted()
+	{
+		Session::Stats stats{};
+
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return stats;
+
+		Session::Batching batching;
+		batching.budget = std::chrono::microseconds(50);
+		{
+			Session session(fds[0], Endpoint{}, 0, nullptr, nullptr, batching);
+			std::thread client([fd = fds[1]]() { Receives(fd, ""); });
+
+			session.SendString("small");
+			session.SendString(std::string(1024 * 1024, 'x'));
+			session.Flush();
+			stats = session.GetStats();
+
+			session.Shutdown();
+			client.join();
+		}
+
+		close(fds[1]);
+		return stats;
+	}
+
+	// The handler sends 1 MiB strings for duration while the client drains them, return the MiB/s
+	int64_t LargeRate(std::chrono::microseconds budget, std::chrono::milliseconds duration)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return -1;
+
+		Session::Batching batching;
+		batching.budget = budget;
+
+		const std::string message(1024 * 1024, 'x');
+		int64_t nbOfMessages = 0, elapsed = 0;
+		{
+			Session session(fds[0], Endpoint{}, 0, nullptr, nullptr, batching);
+			std::thread client([fd = fds[1]]() { Receives(fd, ""); });
+			const Bench::Clock::time_point start = Bench::Clock::now();
+
+			while (Bench::Clock::now() - start < duration)
+			{
+				// A small write first so the big one lands on a batch
+				session.SendString("small");
+				session.SendString(message);
+				nbOfMessages++;
+			}
+
+			session.Flush();
+			elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Bench::Clock::now() - start).count();
+
+			session.Shutdown();
+			client.join();
+		}
+
+		close(fds[1]);
+		return nbOfMessages * 1000000 / std::max<int64_t>(elapsed, 1);
+	}
+}
+
+int Bench::Batching(int argc, char** argv)
+{
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 2000));
+
+	// ================== Regressions ==================
+	const bool kept = ReplyKept();
+	const bool notCounted = RepliesNotCounted();
+	const Session::Stats large = LargeCounted();
+
+	Out() << "[BENCH] : reply sealed on a full socket then a CoalesceLatest broadcast: " << (kept ? "kept" : "LOST") << std::endl;
+	Out() << "[BENCH] : 3 replies queued, broadcast with maxQueued 4 (Drop): " << (notCounted ? "queued" : "DROPPED") << std::endl;
+
+	Out() << "[BENCH] : small write then 1 MiB string (body not copied): " << large.batchedWrites << " writes in " << large.batches << " batches" << std::endl;
+
+	if (not kept || not notCounted || large.batches != 1 || large.batchedWrites != 2)
+		return EXIT_FAILURE;
+
+	// ================== Latency budgets ==================
+	Out() << "[BENCH] : bursts of 8 writes of 8 B every 200 us for " << duration.count() << " ms, latency from the write to the client" << std::endl;
+
+	for (int64_t budget : { 0, 50, 500 })
+	{
+		Samples latencies;
+		Session::Stats stats{};
+
+		if (not Stream(std::chrono::microseconds(budget), duration, &latencies, &stats))
+			return EXIT_FAILURE;
+
+		const size_t writes = latencies.Count();
+		// Without a budget every write is its own send
+		const uint64_t sends = budget == 0 ? writes : stats.batches;
+
+		Out() << "  budget " << budget << " us: " << writes << " writes, " << sends << " sends (" << writes / std::max<uint64_t>(sends, 1) << " writes per send)" << std::endl;
+		Report("write", latencies);
+
+		const int64_t large = LargeRate(std::chrono::microseconds(budget), duration / 4);
+		if (large < 0)
+			return EXIT_FAILURE;
+
+		Out() << "  1 MiB SendString after a batched write: " << large << " MiB/s" << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
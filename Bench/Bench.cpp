@@ -0,0 +1,266 @@
+#include "Bench.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace TCPMachine;
+
+// A session that does not answer within this time counts as dropped
+#define EXCHANGE_TIMEOUT_MS 5000
+
+const std::string Bench::HELLO = "Hello from Bench !";
+
+void Bench::Samples::Add(int64_t value)
+{
+	std::unique_lock<std::mutex> lock(guard);
+	values.push_back(value);
+	sorted = false;
+}
+
+void Bench::Samples::Add(const std::vector<int64_t>& values)
+{
+	std::unique_lock<std::mutex> lock(guard);
+	this->values.insert(this->values.end(), values.begin(), values.end());
+	sorted = false;
+}
+
+size_t Bench::Samples::Count()
+{
+	std::unique_lock<std::mutex> lock(guard);
+	return values.size();
+}
+
+int64_t Bench::Samples::Percentile(double p)
+{
+	std::unique_lock<std::mutex> lock(guard);
+
+	if (values.empty())
+		return 0;
+
+	if (not sorted)
+	{
+		std::sort(values.begin(), values.end());
+		sorted = true;
+	}
+
+	return values[static_cast<size_t>(p * static_cast<double>(values.size() - 1))];
+}
+
+int Bench::Resolve(const char* host, uint16_t port, Target* target)
+{
+	struct addrinfo* address = nullptr, hints {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &address) != 0)
+		return -1;
+
+	std::memcpy(&target->addr, address->ai_addr, address->ai_addrlen);
+	target->len = address->ai_addrlen;
+
+	freeaddrinfo(address);
+	return 0;
+}
+
+int Bench::Connect(const Target& target, const char* source)
+{
+	int fd = socket(target.addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd < 0)
+		return -1;
+
+	if (source != nullptr)
+	{
+		struct sockaddr_storage local {};
+		socklen_t len = 0;
+
+		if (target.addr.ss_family == AF_INET6)
+		{
+			struct sockaddr_in6* addr6 = reinterpret_cast<struct sockaddr_in6*>(&local);
+			addr6->sin6_family = AF_INET6;
+			inet_pton(AF_INET6, source, &addr6->sin6_addr);
+			len = sizeof(*addr6);
+		}
+		else
+		{
+			struct sockaddr_in* addr4 = reinterpret_cast<struct sockaddr_in*>(&local);
+			addr4->sin_family = AF_INET;
+			inet_pton(AF_INET, source, &addr4->sin_addr);
+			len = sizeof(*addr4);
+		}
+
+		if (bind(fd, reinterpret_cast<struct sockaddr*>(&local), len) < 0)
+		{
+			close(fd);
+			return -1;
+		}
+	}
+
+	struct timeval timeout { EXCHANGE_TIMEOUT_MS / 1000, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	int opt = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+	if (target.fastOpen)
+		setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &opt, sizeof(opt));
+
+	if (connect(fd, reinterpret_cast<const struct sockaddr*>(&target.addr), target.len) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+bool Bench::SendString(int fd, const std::string& str)
+{
+	// Header & body in one send so the server gets the frame in one segment
+	std::string frame(4, '\0');
+	const uint32_t len = htonl(static_cast<uint32_t>(str.size()));
+	std::memcpy(&frame[0], &len, sizeof(len));
+	frame += str;
+
+	size_t sent = 0;
+
+	while (sent < frame.size())
+	{
+		ssize_t iResult = send(fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+
+		if (iResult <= 0)
+			return false;
+
+		sent += static_cast<size_t>(iResult);
+	}
+
+	return true;
+}
+
+bool Bench::RecvString(int fd, std::string* str)
+{
+	uint32_t len = 0;
+
+	if (recv(fd, &len, sizeof(len), MSG_WAITALL) != sizeof(len))
+		return false;
+
+	str->resize(ntohl(len));
+
+	if (str->empty())
+		return true;
+
+	return recv(fd, &(*str)[0], str->size(), MSG_WAITALL) == static_cast<ssize_t>(str->size());
+}
+
+int64_t Bench::Exchange(const Target& target, const char* source, const std::string& message)
+{
+	const Clock::time_point start = Clock::now();
+	int fd = Connect(target, source);
+
+	if (fd < 0)
+		return -1;
+
+	std::string reply;
+	bool ok = SendString(fd, message) && RecvString(fd, &reply);
+	close(fd);
+
+	if (not ok)
+		return -1;
+
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+Bench::Load::~Load()
+{
+	Stop();
+}
+
+void Bench::Load::Start(const Target& target, size_t nbClients, const char* source, const std::string& message)
+{
+	running.store(true);
+	results.assign(nbClients, {});
+
+	for (size_t i = 0; i < nbClients; i++)
+	{
+		// Each client only writes its own vector, read once joined
+		clients.emplace_back([this, &target, source, &message, i]() {
+			while (running.load())
+			{
+				const Clock::time_point start = Clock::now();
+				results[i].push_back({ start, Exchange(target, source, message) });
+			}
+		});
+	}
+}
+
+std::vector<Bench::Load::Result> Bench::Load::Stop()
+{
+	running.store(false);
+
+	for (auto& client : clients)
+		client.join();
+
+	clients.clear();
+
+	std::vector<Result> all;
+	for (auto& client : results)
+		all.insert(all.end(), client.begin(), client.end());
+
+	results.clear();
+	return all;
+}
+
+std::ostream& Bench::Out()
+{
+	// Bound to the terminal before main mutes std::cout
+	static std::ostream out(std::cout.rdbuf());
+	return out;
+}
+
+void Bench::Report(const char* name, Samples& samples)
+{
+	Out() << "  " << name << ": " << samples.Count() << " samples, p50: " << samples.Percentile(0.50) << " us, p99: "
+		<< samples.Percentile(0.99) << " us, p99.9: " << samples.Percentile(0.999) << " us, max: " << samples.Percentile(1.0) << " us" << std::endl;
+}
+
+long Bench::Option(int argc, char** argv, const char* name, long fallback)
+{
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (std::strcmp(argv[i], name) != 0)
+			continue;
+
+		char* end = nullptr;
+		long value = std::strtol(argv[i + 1], &end, 10);
+
+		if (end == argv[i + 1] || *end != '\0' || value < 0)
+		{
+			Out() << "[BENCH] : Invalid value for " << name << ": " << argv[i + 1] << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+
+		return value;
+	}
+
+	return fallback;
+}
+
+bool Bench::Flag(int argc, char** argv, const char* name)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], name) == 0)
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ostream>
+#include <sys/socket.h>
+
+namespace TCPMachine {
+
+	// Scenarios run against an in-process Server on the loopback, one per feature of the server.
+	// The logs of the server are muted, only the results are printed.
+	namespace Bench {
+
+		using Clock = std::chrono::steady_clock;
+
+		// Latencies (or any value) collected by several threads
+		class Samples {
+
+		public:
+
+			void Add(int64_t value);
+			// Merge the samples of a thread once it is done
+			void Add(const std::vector<int64_t>& values);
+
+			size_t Count();
+			// p in [0, 1], 0 if there is no sample. Sorts the samples
+			int64_t Percentile(double p);
+
+		private:
+
+			std::mutex guard;
+			std::vector<int64_t> values;
+			bool sorted = false;
+		};
+
+		// Address of the server, resolved once
+		struct Target {
+			struct sockaddr_storage addr {};
+			socklen_t len = 0;
+			// Connect with TCP_FASTOPEN_CONNECT, the first message leaves with the SYN once we have a cookie
+			bool fastOpen = false;
+		};
+
+		// Return 0 if it succeed or -1 if it failed
+		int Resolve(const char* host, uint16_t port, Target* target);
+
+		// Blocking TCP connection to the target, bound to source (an IP, nullptr for any)
+		// Return the socket or -1 if it failed (refused, reset, timed out)
+		int Connect(const Target& target, const char* source = nullptr);
+
+		// Framed like Session::SendString / Session::RecvString
+		bool SendString(int fd, const std::string& str);
+		bool RecvString(int fd, std::string* str);
+
+		// Sent by the clients unless a scenario picks another message
+		extern const std::string HELLO;
+
+		// One session of the demo handler: connect, send a message, wait for the reply
+		// Return the time it took in us or -1 if the server refused or dropped it
+		int64_t Exchange(const Target& target, const char* source = nullptr, const std::string& message = HELLO);
+
+		// Clients running Exchange in a loop until Stop, each result is kept with its start time
+		class Load {
+
+		public:
+
+			struct Result {
+				Clock::time_point start;
+				// In us, -1 if refused or dropped
+				int64_t latency;
+			};
+
+			~Load();
+
+			// nbClients threads, bound to source (nullptr for any), target & message must outlive the load
+			void Start(const Target& target, size_t nbClients, const char* source = nullptr, const std::string& message = HELLO);
+			// Join the clients, return the results of all of them
+			std::vector<Result> Stop();
+
+		private:
+
+			std::atomic_bool running{ false };
+			std::vector<std::thread> clients;
+			std::vector<std::vector<Result>> results;
+		};
+
+		// Where the results go, the server logs on std::cout & std::cerr are muted
+		std::ostream& Out();
+
+		// Print "name: count, p50, p99, p99.9, max" in us
+		void Report(const char* name, Samples& samples);
+
+		// Value of --name <value> in the arguments or fallback, exits on a value that is not a positive number
+		long Option(int argc, char** argv, const char* name, long fallback);
+		// True if --name is in the arguments
+		bool Flag(int argc, char** argv, const char* name);
+
+		// ================== Scenarios ==================
+		// Each one returns EXIT_SUCCESS or EXIT_FAILURE
+
+		// Refusals & latency while a server hands its listener to another one (vs a cold restart)
+		int HotRestart(int argc, char** argv);
+		// Latency percentiles with more clients than workers, sessions wait in the worker deques
+		int Tail(int argc, char** argv);
+		// Cost of the peer of an accepted socket & sessions accepted per second with short sessions
+		int Accept(int argc, char** argv);
+		// Every socket profile with small & 1 MiB messages, with & without TCP fast open on the client
+		int Profiles(int argc, char** argv);
+		// Publish to 10k sessions on socketpairs while another thread (un)subscribes
+		int Fanout(int argc, char** argv);
+		// Pooled vs new connections, and reuse of connections the server closed
+		int Pool(int argc, char** argv);
+		// Unpinned vs pinned on the nodes of the machine vs pinned on simulated nodes
+		int Pin(int argc, char** argv);
+		// Memory & create/destroy rate of 100k sessions in the slab & the registry, without sockets
+		int Footprint(int argc, char** argv);
+		// 50k registered sessions churning while the admin lists, queries, kills & sends, cost on the data path
+		int Registry(int argc, char** argv);
+		// Cost of a rate limit check, latency of 100 well-behaved clients next to one over its limits
+		int Limiter(int argc, char** argv);
+		// Frames decoded per second by RecvString from 16 B to 1 MiB, next to a raw recv of the same bytes
+		int Decoder(int argc, char** argv);
+		// Replies kept by the overflow policy, then latency & writes per send at batching budgets of 0, 50 & 500 us
+		int Batching(int argc, char** argv);
+		// A full capture log ends with a Truncated record, then decode rate & sessions/s with the capture off vs on
+		int Capture(int argc, char** argv);
+	}
+}
@@ -0,0 +1,266 @@
+#include "Bench.hpp"
+
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../Server/Server.hpp"
+#include "../Server/Session.hpp"
+#include "../Server/Capture.hpp"
+
+using namespace TCPMachine;
+
+#define CAPTURE_PATH "/tmp/tcpmachine-bench.capture"
+
+namespace {
+
+	// One frame of size bytes as sent by a client
+	std::string Frame(uint32_t size)
+	{
+		const uint32_t length = htonl(size);
+		std::string frame(reinterpret_cast<const char*>(&length), sizeof(length));
+		frame.append(size, 'x');
+		return frame;
+	}
+
+	// What a capture file holds once closed
+	struct Content {
+		size_t nbOfSessions = 0;
+		// Sessions with an Open record & no Close
+		size_t nbOfUnclosed = 0;
+		bool truncated = false;
+		// Records after the Truncated one
+		size_t nbAfter = 0;
+	};
+
+	bool Read(const char* path, Content* content)
+	{
+		std::ifstream file(path, std::ios::binary);
+		const std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		CaptureFormat::FileHeader header;
+		if (bytes.size() < sizeof(header))
+			return false;
+
+		std::memcpy(&header, bytes.data(), sizeof(header));
+
+		std::vector<uint64_t> opened, closed;
+		size_t offset = sizeof(header);
+
+		while (offset + sizeof(CaptureFormat::RecordHeader) <= sizeof(header) + header.length)
+		{
+			CaptureFormat::RecordHeader record;
+			std::memcpy(&record, bytes.data() + offset, sizeof(record));
+			offset += sizeof(record) + record.length;
+
+			if (content->truncated)
+				content->nbAfter++;
+			else if (record.type == CaptureFormat::RecordType::Truncated)
+				content->truncated = true;
+			else if (record.type == CaptureFormat::RecordType::Open)
+				opened.push_back(record.sessionId);
+			else if (record.type == CaptureFormat::RecordType::Close)
+				closed.push_back(record.sessionId);
+		}
+
+		content->nbOfSessions = opened.size();
+
+		for (uint64_t id : opened)
+			content->nbOfUnclosed += std::find(closed.begin(), closed.end(), id) == closed.end() ? 1 : 0;
+
+		return true;
+	}
+
+	// 32 sessions open at once, each receiving 96 KiB (one batch flushed while it runs) into a 1 MiB log:
+	// the log fills while some of them flushed their Open & have their Close still to come
+	bool FullLog(Content* content)
+	{
+		CaptureLog log;
+
+		if (log.Open(CAPTURE_PATH, 1024 * 1024) < 0)
+			return false;
+
+		std::vector<std::unique_ptr<Session>> sessions;
+		std::vector<int> peers;
+		const std::string frame = Frame(4096);
+
+		for (size_t i = 0; i < 32; i++)
+		{
+			int fds[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+				return false;
+
+			sessions.push_back(std::make_unique<Session>(fds[0], Endpoint{}, 0, nullptr, &log, Session::Batching()));
+			peers.push_back(fds[1]);
+		}
+
+		std::string str;
+
+		for (size_t i = 0; i < sessions.size(); i++)
+		{
+			for (size_t j = 0; j < 24; j++)
+			{
+				if (send(peers[i], frame.data(), frame.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(frame.size()))
+					return false;
+
+				sessions[i]->RecvString(&str);
+			}
+		}
+
+		// Their Close records are written now
+		sessions.clear();
+
+		for (int fd : peers)
+			close(fd);
+
+		log.Close();
+
+		const bool read = Read(CAPTURE_PATH, content);
+		unlink(CAPTURE_PATH);
+		return read;
+	}
+
+	// The client sends frames of size on a socketpair while a session decodes them for duration
+	// Return the frames decoded per second
+	int64_t RecvRate(CaptureLog* log, uint32_t size, std::chrono::milliseconds duration)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return -1;
+
+		std::string frames;
+		while (frames.size() < 1024 * 1024)
+			frames += Frame(size);
+
+		std::atomic_bool running{ true };
+
+		std::thread client([&frames, &running, fd = fds[1]]() {
+			while (running.load(std::memory_order_relaxed))
+			{
+				if (send(fd, frames.data(), frames.size(), MSG_NOSIGNAL) < 0)
+					break;
+			}
+
+			shutdown(fd, SHUT_WR);
+		});
+
+		int64_t nbOfFrames = 0, elapsed = 0;
+		{
+			Session session(fds[0], Endpoint{}, 0, nullptr, log, Session::Batching());
+			std::string str;
+			const Bench::Clock::time_point start = Bench::Clock::now();
+			Bench::Clock::time_point now = start;
+
+			while (now - start < duration)
+			{
+				// A check of the clock every 64 frames at most
+				for (size_t i = 0; i < 64; i++)
+					session.RecvString(&str);
+
+				nbOfFrames += 64;
+				now = Bench::Clock::now();
+			}
+
+			elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+
+			// Drain so the client sees the end of the run
+			running.store(false);
+			char buffer[64 * 1024];
+			while (recv(fds[0], buffer, sizeof(buffer), 0) > 0);
+		}
+
+		client.join();
+		close(fds[1]);
+
+		return nbOfFrames * 1000000 / std::max<int64_t>(elapsed, 1);
+	}
+}
+
+int Bench::Capture(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 16));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 2000));
+
+	// ================== Regression: full log ==================
+	Content content;
+
+	if (not FullLog(&content))
+		return EXIT_FAILURE;
+
+	Out() << "[BENCH] : 1 MiB log, 32 sessions of 96 KiB: " << content.nbOfSessions << " sessions recorded, " << content.nbOfUnclosed << " without Close, "
+		<< (content.truncated ? "Truncated record last" : "NO Truncated record") << ", " << content.nbAfter << " records after it" << std::endl;
+
+	// Every session recorded either has its Close or is cut by the Truncated record
+	if ((content.nbOfUnclosed > 0 && not content.truncated) || content.nbAfter > 0)
+		return EXIT_FAILURE;
+
+	// ================== Decode rate ==================
+	Out() << "[BENCH] : One session decoding for " << duration.count() / 2 << " ms, capture off vs on" << std::endl;
+
+	for (uint32_t size : { 64u, 4096u })
+	{
+		const int64_t off = RecvRate(nullptr, size, duration / 2);
+
+		CaptureLog log;
+		if (log.Open(CAPTURE_PATH, size_t(1) << 30) < 0)
+			return EXIT_FAILURE;
+
+		const int64_t on = RecvRate(&log, size, duration / 2);
+		log.Close();
+		unlink(CAPTURE_PATH);
+
+		if (off < 0 || on < 0)
+			return EXIT_FAILURE;
+
+		Out() << "  " << size << " B frames: off " << off << " frames/s, on " << on << " frames/s (" << (on * 100 / std::max<int64_t>(off, 1)) << "%)" << std::endl;
+	}
+
+	// ================== Sessions of the demo handler ==================
+	Target target;
+	if (Resolve("127.0.0.1", port, &target) < 0)
+		return EXIT_FAILURE;
+
+	Out() << "[BENCH] : " << nbClients << " clients, capture off vs on" << std::endl;
+
+	for (bool capturing : { false, true })
+	{
+		Samples samples;
+		size_t failed = 0;
+		{
+			Server server(port, 2);
+
+			if (capturing && server.StartCapture(CAPTURE_PATH, size_t(1) << 30) < 0)
+				return EXIT_FAILURE;
+
+			if (server.Start() < 0)
+				return EXIT_FAILURE;
+
+			Load load;
+			load.Start(target, nbClients);
+			std::this_thread::sleep_for(duration);
+
+			for (const auto& result : load.Stop())
+			{
+				if (result.latency < 0)
+					failed++;
+				else
+					samples.Add(result.latency);
+			}
+
+			server.Stop();
+		}
+
+		unlink(CAPTURE_PATH);
+
+		Out() << "  capture " << (capturing ? "on" : "off") << ": refused/dropped: " << failed << ", sessions/s: " << samples.Count() * 1000 / static_cast<size_t>(duration.count()) << std::endl;
+		Report("session", samples);
+	}
+
+	return EXIT_SUCCESS;
+}
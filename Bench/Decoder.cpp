@@ -0,0 +1,108 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../Server/Session.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	// Frames of size bytes, at least 1 MiB of them so the client sends big buffers
+	std::string Frames(uint32_t size)
+	{
+		const uint32_t length = htonl(size);
+		std::string frame(reinterpret_cast<const char*>(&length), sizeof(length));
+		frame.append(size, 'x');
+
+		std::string frames;
+		while (frames.size() < 1024 * 1024)
+			frames += frame;
+
+		return frames;
+	}
+
+	// The client sends frames in a loop on a socketpair while the session decodes them for duration
+	// Return the frames decoded per second, raw: recv of the same stream in RECV_CHUNK reads instead
+	int64_t DecodeRate(uint32_t size, bool raw, std::chrono::milliseconds duration)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return -1;
+
+		const std::string frames = Frames(size);
+		std::atomic_bool running{ true };
+
+		std::thread client([&frames, &running, fd = fds[1]]() {
+			while (running.load(std::memory_order_relaxed))
+			{
+				if (send(fd, frames.data(), frames.size(), MSG_NOSIGNAL) < 0)
+					break;
+			}
+
+			shutdown(fd, SHUT_WR);
+		});
+
+		Session session(fds[0], Endpoint{}, 0, nullptr, nullptr, Session::Batching());
+		std::string str;
+		std::vector<char> buffer(Session::RECV_CHUNK);
+		uint64_t nbOfBytes = 0;
+		const Bench::Clock::time_point start = Bench::Clock::now();
+		Bench::Clock::time_point now = start;
+
+		while (now - start < duration)
+		{
+			// A check of the clock every 64 frames at most
+			for (size_t i = 0; i < 64; i++)
+			{
+				if (raw)
+				{
+					const ssize_t received = recv(fds[0], buffer.data(), buffer.size(), 0);
+					nbOfBytes += received > 0 ? static_cast<uint64_t>(received) : 0;
+				}
+				else
+				{
+					session.RecvString(&str);
+					nbOfBytes += sizeof(uint32_t) + str.size();
+				}
+			}
+
+			now = Bench::Clock::now();
+		}
+
+		const int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+
+		// Drain so the client sees the end of the run
+		running.store(false);
+		while (recv(fds[0], buffer.data(), buffer.size(), 0) > 0);
+
+		client.join();
+		close(fds[1]);
+
+		return static_cast<int64_t>(nbOfBytes / (sizeof(uint32_t) + size)) * 1000000 / std::max<int64_t>(elapsed, 1);
+	}
+}
+
+int Bench::Decoder(int argc, char** argv)
+{
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 1000));
+
+	Out() << "[BENCH] : RecvString on a socketpair, " << duration.count() << " ms per size, raw: recv of the same bytes in " << Session::RECV_CHUNK / 1024 << " KiB reads" << std::endl;
+
+	for (uint32_t size : { 16u, 1024u, 64u * 1024, 1024u * 1024 })
+	{
+		const int64_t decoded = DecodeRate(size, false, duration);
+		const int64_t raw = DecodeRate(size, true, duration);
+
+		if (decoded < 0 || raw < 0)
+			return EXIT_FAILURE;
+
+		Out() << "  " << size << " B: " << decoded << " frames/s, " << decoded * (sizeof(uint32_t) + size) / (1024 * 1024) << " MiB/s (raw: "
+			<< raw * (sizeof(uint32_t) + size) / (1024 * 1024) << " MiB/s)" << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <memory>
+#include <functional>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "../Server/Broadcaster.hpp"
+#include "../Server/OutboundWriter.hpp"
+#include "../Server/SessionRegistry.hpp"
+
+using namespace TCPMachine;
+
+#define FANOUT_TOPIC "bench"
+
+namespace {
+
+	// A 1 MiB frame queued on a small send buffer while the worker is blocked in recv,
+	// return the bytes the client got within 2 s (all of them: the writer sent the rest)
+	size_t BigFrame(OutboundWriter* writer, SessionRegistry* registry)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return 0;
+
+		const int sendBuffer = 4096;
+		setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+
+		const SharedFrame frame = Broadcaster::Frame(std::string(1024 * 1024, 'b'));
+		size_t received = 0;
+		{
+			Session session(fds[0], Endpoint{}, 0, nullptr, nullptr, Session::Batching());
+			registry->Register(1, &session);
+			session.Attach(1, nullptr, writer);
+
+			// Blocked until the client ends the run
+			std::thread worker([&session]() {
+				try
+				{
+					std::string message;
+					session.RecvString(&message);
+				}
+				catch (const std::exception&)
+				{
+				}
+			});
+
+			session.Enqueue(frame, 64, Session::OverflowPolicy::Drop);
+
+			const Bench::Clock::time_point deadline = Bench::Clock::now() + std::chrono::seconds(2);
+			char buffer[64 * 1024];
+			struct pollfd readable { fds[1], POLLIN, 0 };
+
+			while (received < frame->size() && Bench::Clock::now() < deadline && poll(&readable, 1, 100) >= 0)
+			{
+				const ssize_t iResult = recv(fds[1], buffer, sizeof(buffer), MSG_DONTWAIT);
+				received += iResult > 0 ? static_cast<size_t>(iResult) : 0;
+			}
+
+			shutdown(fds[1], SHUT_WR);
+			worker.join();
+			registry->Unregister(1);
+		}
+
+		close(fds[1]);
+		return received;
+	}
+}
+
+int Bench::Fanout(int argc, char** argv)
+{
+	size_t nbSubscribers = static_cast<size_t>(Option(argc, argv, "--subscribers", 10000));
+	const size_t nbPublishes = static_cast<size_t>(Option(argc, argv, "--publishes", 200));
+	const size_t payloadSize = static_cast<size_t>(Option(argc, argv, "--payload", 64));
+	const bool churning = Option(argc, argv, "--churn", 1) > 0;
+
+	// Two fds per subscriber, the fd limit may not allow all of them
+	struct rlimit limit {};
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	if (limit.rlim_cur != RLIM_INFINITY && nbSubscribers > (limit.rlim_cur - 64) / 2)
+		nbSubscribers = (limit.rlim_cur - 64) / 2;
+
+	SessionRegistry registry;
+	OutboundWriter writer(&registry);
+
+	if (writer.Start() < 0)
+		return EXIT_FAILURE;
+
+	// ================== Rest of a frame on a full socket ==================
+	const size_t big = BigFrame(&writer, &registry);
+	Out() << "[BENCH] : 1 MiB frame, 4 KiB send buffer, worker blocked in recv: " << big << " of " << 1024 * 1024 + 4 << " bytes received" << std::endl;
+
+	if (big != 1024 * 1024 + 4)
+		return EXIT_FAILURE;
+
+	// ================== Subscribers on socketpairs ==================
+	CaptureLog capture;
+	Broadcaster broadcaster;
+	std::vector<std::unique_ptr<Session>> sessions;
+	std::vector<int> peers;
+
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	for (size_t i = 0; i < nbSubscribers + 1; i++)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return EXIT_FAILURE;
+
+		sessions.push_back(std::make_unique<Session>(fds[0], Endpoint{}, 0, nullptr, &capture, Session::Batching()));
+		peers.push_back(fds[1]);
+
+		// Ids from 1, as the slab hands them out
+		registry.Register(i + 1, sessions.back().get());
+		sessions.back()->Attach(i + 1, nullptr, &writer);
+
+		struct epoll_event event {};
+		event.events = EPOLLIN;
+		event.data.u32 = static_cast<uint32_t>(i);
+		epoll_ctl(epfd, EPOLL_CTL_ADD, fds[1], &event);
+	}
+
+	// The last one is (un)subscribed in a loop while publishing
+	for (size_t i = 0; i < nbSubscribers; i++)
+		broadcaster.Subscribe(FANOUT_TOPIC, sessions[i].get());
+
+	const size_t frameSize = payloadSize + sizeof(uint32_t);
+	Out() << "[BENCH] : " << nbSubscribers << " subscribers, " << nbPublishes << " publishes of " << payloadSize << " B, each one read by every subscriber before the next" << std::endl;
+
+	// ================== Drain the subscribers ==================
+	std::atomic_bool running{ true };
+	// Bytes every subscriber has to read for the current round & nb of subscribers that did
+	std::atomic<uint64_t> target{ 0 };
+	std::atomic<size_t> done{ 0 };
+
+	std::thread reader([&]() {
+		struct epoll_event events[512];
+		char buffer[64 * 1024];
+		// Only touched by this thread
+		std::vector<uint64_t> bytes(peers.size(), 0);
+
+		while (running.load())
+		{
+			int nb = epoll_wait(epfd, events, 512, 10);
+
+			for (int i = 0; i < nb; i++)
+			{
+				const uint32_t index = events[i].data.u32;
+				ssize_t iResult = read(peers[index], buffer, sizeof(buffer));
+
+				if (iResult <= 0)
+					continue;
+
+				const uint64_t before = bytes[index];
+				bytes[index] += static_cast<uint64_t>(iResult);
+
+				// The churned subscriber does not count
+				if (index < nbSubscribers && before < target.load() && bytes[index] >= target.load())
+					done++;
+			}
+		}
+	});
+
+	// ================== Subscribe churn while publishing ==================
+	Samples subscribeTimes;
+
+	std::thread churn([&]() {
+		std::vector<int64_t> times;
+		Session* session = sessions.back().get();
+
+		while (churning && running.load())
+		{
+			const Clock::time_point start = Clock::now();
+			broadcaster.Subscribe(FANOUT_TOPIC, session);
+			broadcaster.Unsubscribe(FANOUT_TOPIC, session);
+			times.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+
+			// A session starting or ending now & then, not a busy loop eating the CPU of the publisher
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		subscribeTimes.Add(times);
+	});
+
+	// ================== Publish vs one SendString per subscriber ==================
+	const std::string payload(payloadSize, 'x');
+	uint64_t round = 0;
+
+	// Send one frame to every subscriber with send, wait until the last one read it
+	// Return the nb of rounds some subscriber did not get its frame within 1 s
+	auto Rounds = [&](const std::function<void()>& send, Samples* times, double* seconds) -> size_t {
+		size_t missed = 0;
+		const Clock::time_point start = Clock::now();
+
+		for (size_t i = 0; i < nbPublishes; i++)
+		{
+			done.store(0);
+			target.store(++round * frameSize);
+
+			const Clock::time_point begin = Clock::now();
+			send();
+
+			const Clock::time_point deadline = begin + std::chrono::seconds(1);
+			while (done.load() < nbSubscribers && Clock::now() < deadline)
+				std::this_thread::yield();
+
+			if (done.load() < nbSubscribers)
+				missed++;
+
+			times->Add(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count());
+		}
+
+		*seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		return missed;
+	};
+
+	Samples publishTimes, sendTimes;
+	double publishSeconds = 0, sendSeconds = 0;
+
+	const size_t publishMissed = Rounds([&]() { broadcaster.Publish(FANOUT_TOPIC, payload); }, &publishTimes, &publishSeconds);
+	const size_t sendMissed = Rounds([&]() {
+		for (size_t i = 0; i < nbSubscribers; i++)
+			sessions[i]->SendString(payload);
+	}, &sendTimes, &sendSeconds);
+
+	running.store(false);
+	churn.join();
+	reader.join();
+
+	const double frames = static_cast<double>(nbSubscribers * nbPublishes);
+
+	Out() << "  Publish: " << frames / publishSeconds << " frames/s, rounds not read by all within 1 s: " << publishMissed << std::endl;
+	Report("publish to the last subscriber read", publishTimes);
+	Out() << "  " << nbSubscribers << " x SendString: " << frames / sendSeconds << " frames/s, rounds not read by all within 1 s: " << sendMissed << std::endl;
+	Report("sends to the last subscriber read", sendTimes);
+	Out() << "  bytes copied to frame a message: Publish " << frameSize << " B once for the " << nbSubscribers << " subscribers, "
+		<< nbSubscribers << " x SendString " << nbSubscribers * frameSize << " B with a batching budget (one copy per session), 0 B without it but 2 sends per session" << std::endl;
+	Report("subscribe + unsubscribe", subscribeTimes);
+
+	// Before the sessions are destroyed
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		broadcaster.UnsubscribeAll(sessions[i].get());
+		registry.Unregister(i + 1);
+	}
+
+	writer.Stop();
+	sessions.clear();
+
+	for (int fd : peers)
+		close(fd);
+
+	close(epfd);
+	return (publishMissed == 0 && sendMissed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
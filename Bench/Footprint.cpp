@@ -0,0 +1,233 @@
+#include "Bench.hpp"
+
+#include <memory>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <unistd.h>
+#include <malloc.h>
+
+#include "../Server/Slab.hpp"
+#include "../Server/Session.hpp"
+#include "../Server/SessionManager.hpp"
+#include "../Server/SessionRegistry.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	// Resident bytes of the process
+	size_t Resident()
+	{
+		size_t pages = 0, resident = 0;
+		FILE* statm = std::fopen("/proc/self/statm", "r");
+
+		if (statm == nullptr)
+			return 0;
+
+		if (std::fscanf(statm, "%zu %zu", &pages, &resident) != 2)
+			resident = 0;
+
+		std::fclose(statm);
+		return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	}
+
+	int64_t NsSince(Bench::Clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now() - start).count();
+	}
+
+	// Sessions in the slab of the SessionManager
+	class SlabStore {
+
+	public:
+
+		explicit SlabStore(size_t capacity) : slab(capacity) {}
+
+		uint64_t Create(int64_t now)
+		{
+			return slab.Create(-1, Endpoint{}, now, nullptr, nullptr, Session::Batching());
+		}
+
+		Session* Get(uint64_t id)
+		{
+			return slab.Get(id);
+		}
+
+		void Destroy(uint64_t id)
+		{
+			slab.Destroy(id);
+		}
+
+	private:
+
+		Slab<Session> slab;
+	};
+
+	// Baseline: one new Session per connection, the id is its index + 1, freed indexes are reused
+	class HeapStore {
+
+	public:
+
+		explicit HeapStore(size_t capacity)
+		{
+			sessions.reserve(capacity);
+		}
+
+		uint64_t Create(int64_t now)
+		{
+			auto session = std::make_unique<Session>(-1, Endpoint{}, now, nullptr, nullptr, Session::Batching());
+
+			if (free.empty())
+			{
+				sessions.push_back(std::move(session));
+				return sessions.size();
+			}
+
+			const uint64_t id = free.back();
+			free.pop_back();
+			sessions[id - 1] = std::move(session);
+			return id;
+		}
+
+		Session* Get(uint64_t id)
+		{
+			return sessions[id - 1].get();
+		}
+
+		void Destroy(uint64_t id)
+		{
+			sessions[id - 1].reset();
+			free.push_back(id);
+		}
+
+	private:
+
+		std::vector<std::unique_ptr<Session>> sessions;
+		std::vector<uint64_t> free;
+	};
+
+	// Create, register, query, dispatch events to, destroy & churn nbSessions sessions of the store
+	template <typename Store>
+	void Measure(const char* name, size_t nbSessions, size_t nbEvents)
+	{
+		Bench::Out() << "  " << name << ":" << std::endl;
+
+		// ================== Reserve ==================
+		const size_t empty = Resident();
+		auto store = std::make_unique<Store>(nbSessions);
+
+		Bench::Out() << "    empty: " << (Resident() - empty) / 1024 << " KiB resident" << std::endl;
+
+		SessionRegistry registry;
+
+		const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now().time_since_epoch()).count();
+		std::vector<uint64_t> ids;
+		ids.reserve(nbSessions);
+
+		// ================== Create & register ==================
+		const size_t before = Resident();
+		Bench::Clock::time_point start = Bench::Clock::now();
+
+		for (size_t i = 0; i < nbSessions; i++)
+		{
+			const uint64_t id = store->Create(now);
+
+			if (id == Slab<Session>::INVALID)
+				break;
+
+			registry.Register(id, store->Get(id));
+			ids.push_back(id);
+		}
+
+		int64_t elapsed = NsSince(start);
+		const size_t full = Resident();
+
+		Bench::Out() << "    create + register: " << ids.size() << " sessions in " << elapsed / 1000 << " us, "
+			<< static_cast<int64_t>(ids.size()) * 1000000000 / std::max<int64_t>(elapsed, 1) << " sessions/s" << std::endl;
+		Bench::Out() << "    resident: " << (full - before) / 1024 << " KiB, " << (full - before) / std::max<size_t>(ids.size(), 1) << " B per session" << std::endl;
+
+		// ================== Admin lookups ==================
+		start = Bench::Clock::now();
+		size_t found = 0;
+
+		for (uint64_t id : ids)
+		{
+			SessionRegistry::Info info;
+			found += registry.Query(id, &info) ? 1 : 0;
+		}
+
+		elapsed = NsSince(start);
+		Bench::Out() << "    query: " << found << " found, " << elapsed / std::max<int64_t>(static_cast<int64_t>(ids.size()), 1) << " ns per query" << std::endl;
+
+		// ================== Events on random sessions ==================
+		// What the writer does on EPOLLOUT: look the session up by id & try to send its queue (empty here)
+		std::vector<uint64_t> events(nbEvents);
+		std::minstd_rand random(1);
+
+		for (uint64_t& id : events)
+			id = ids[random() % ids.size()];
+
+		start = Bench::Clock::now();
+
+		for (uint64_t id : events)
+			registry.SendQueued(id);
+
+		elapsed = NsSince(start);
+		Bench::Out() << "    events through the registry: " << static_cast<int64_t>(events.size()) * 1000000000 / std::max<int64_t>(elapsed, 1) << " events/s on " << ids.size() << " sessions in a random order" << std::endl;
+
+		// What the flusher finds once the session is known: its batch deadline (none here)
+		start = Bench::Clock::now();
+
+		for (uint64_t id : events)
+			store->Get(id)->FlushExpired(now);
+
+		elapsed = NsSince(start);
+		Bench::Out() << "    events on the session only: " << static_cast<int64_t>(events.size()) * 1000000000 / std::max<int64_t>(elapsed, 1) << " events/s" << std::endl;
+
+		// ================== Unregister & destroy ==================
+		start = Bench::Clock::now();
+
+		for (uint64_t id : ids)
+		{
+			registry.Unregister(id);
+			store->Destroy(id);
+		}
+
+		elapsed = NsSince(start);
+		Bench::Out() << "    unregister + destroy: " << static_cast<int64_t>(ids.size()) * 1000000000 / std::max<int64_t>(elapsed, 1) << " sessions/s" << std::endl;
+
+		// ================== Churn on the freed slots ==================
+		const size_t churned = Resident();
+		start = Bench::Clock::now();
+
+		for (size_t i = 0; i < nbSessions; i++)
+		{
+			const uint64_t id = store->Create(now);
+			registry.Register(id, store->Get(id));
+			registry.Unregister(id);
+			store->Destroy(id);
+		}
+
+		elapsed = NsSince(start);
+		Bench::Out() << "    churn of one session: " << static_cast<int64_t>(nbSessions) * 1000000000 / std::max<int64_t>(elapsed, 1) << " sessions/s, resident growth: "
+			<< (Resident() > churned ? (Resident() - churned) / 1024 : 0) << " KiB" << std::endl;
+	}
+}
+
+int Bench::Footprint(int argc, char** argv)
+{
+	const size_t nbSessions = static_cast<size_t>(Option(argc, argv, "--sessions", SessionManager::MAX_SESSIONS));
+	const size_t nbEvents = static_cast<size_t>(Option(argc, argv, "--events", 1000000));
+
+	Out() << "[BENCH] : " << nbSessions << " sessions without socket (fd -1), sizeof(Session): " << sizeof(Session) << " B, "
+		<< nbSessions * ((sizeof(Session) + 63) / 64 * 64 + 64) / 1024 << " KiB reserved by the slab" << std::endl;
+
+	Measure<SlabStore>("slab", nbSessions, nbEvents);
+	// Give the freed registry entries & deques back, the heap run must not find them resident
+	malloc_trim(0);
+	Measure<HeapStore>("heap (std::make_unique per session)", nbSessions, nbEvents);
+
+	return EXIT_SUCCESS;
+}
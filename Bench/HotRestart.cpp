@@ -0,0 +1,117 @@
+#include "Bench.hpp"
+
+#include <memory>
+#include <cstdlib>
+
+#include "../Server/Server.hpp"
+
+using namespace TCPMachine;
+
+#define HOTRESTART_PATH "/tmp/tcpmachine-bench/handoff.sock"
+
+namespace {
+
+	// Print the results started before, during & after the restart window
+	void ReportWindow(const std::vector<Bench::Load::Result>& results, Bench::Clock::time_point begin, Bench::Clock::time_point end)
+	{
+		Bench::Samples before, during, after;
+		size_t failedBefore = 0, failedDuring = 0, failedAfter = 0;
+
+		for (const auto& result : results)
+		{
+			Bench::Samples* samples = result.start < begin ? &before : result.start <= end ? &during : &after;
+			size_t* failed = result.start < begin ? &failedBefore : result.start <= end ? &failedDuring : &failedAfter;
+
+			if (result.latency < 0)
+				(*failed)++;
+			else
+				samples->Add(result.latency);
+		}
+
+		Bench::Out() << "  restart window: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << " us" << std::endl;
+		Bench::Out() << "  refused/dropped before: " << failedBefore << ", during: " << failedDuring << ", after: " << failedAfter << std::endl;
+		Bench::Report("before", before);
+		Bench::Report("during", during);
+		Bench::Report("after", after);
+	}
+}
+
+int Bench::HotRestart(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 8));
+	const auto steady = std::chrono::milliseconds(Option(argc, argv, "--ms", 1000));
+
+	Target target;
+	if (Resolve("127.0.0.1", port, &target) < 0)
+		return EXIT_FAILURE;
+
+	// ================== Hot: the listener is handed off ==================
+	{
+		Out() << "[BENCH] : Hand off, " << nbClients << " clients" << std::endl;
+
+		auto oldServer = std::make_unique<Server>(port, 2);
+		auto newServer = std::make_unique<Server>(port, 2);
+
+		if (oldServer->Start() < 0)
+			return EXIT_FAILURE;
+
+		Load load;
+		load.Start(target, nbClients);
+		std::this_thread::sleep_for(steady);
+
+		const Clock::time_point begin = Clock::now();
+		Clock::time_point end;
+
+		std::thread takeOver([&newServer, &end]() {
+			if (newServer->TakeOver(HOTRESTART_PATH, std::chrono::seconds(5)) == 0)
+				newServer->Start();
+			end = Clock::now();
+		});
+
+		// Returns once the old server drained its active sessions
+		int result = oldServer->HandOffListener(HOTRESTART_PATH, std::chrono::seconds(5));
+		takeOver.join();
+
+		std::this_thread::sleep_for(steady);
+		ReportWindow(load.Stop(), begin, end);
+		newServer->Stop();
+
+		if (result < 0)
+			return EXIT_FAILURE;
+	}
+
+	// ================== Cold: stop then start a new server ==================
+	{
+		Out() << "[BENCH] : Cold restart, " << nbClients << " clients" << std::endl;
+
+		auto oldServer = std::make_unique<Server>(port, 2);
+
+		if (oldServer->Start() < 0)
+			return EXIT_FAILURE;
+
+		Load load;
+		load.Start(target, nbClients);
+		std::this_thread::sleep_for(steady);
+
+		const Clock::time_point begin = Clock::now();
+
+		oldServer->Stop();
+		oldServer.reset();
+
+		auto newServer = std::make_unique<Server>(port, 2);
+		newServer->Start();
+
+		// Start only spawns the listener, wait for it to accept
+		while (Exchange(target) < 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		const Clock::time_point end = Clock::now();
+
+		std::this_thread::sleep_for(steady);
+		ReportWindow(load.Stop(), begin, end);
+		newServer->Stop();
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../Server/Server.hpp"
+#include "../Server/RateLimiter.hpp"
+
+using namespace TCPMachine;
+
+// Source of the client that does not respect the limits, the well-behaved ones are 127.0.1.x
+#define ABUSER_IP "127.0.0.2"
+
+namespace {
+
+	// IPv4 mapped key of 10.x.y.z or 2001:db8::/32 key
+	RateLimiter::Key MakeKey(uint32_t n, bool v6, uint64_t interface)
+	{
+		RateLimiter::Key key{};
+
+		if (v6)
+		{
+			key[0] = 0x20;
+			key[1] = 0x01;
+			key[2] = 0x0d;
+			key[3] = 0xb8;
+			std::memcpy(key.data() + 4, &n, sizeof(n));
+			std::memcpy(key.data() + 8, &interface, sizeof(interface));
+		}
+		else
+		{
+			key[10] = 0xff;
+			key[11] = 0xff;
+			const uint32_t address = htonl(0x0A000000 | (n & 0x00FFFFFF));
+			std::memcpy(key.data() + 12, &address, sizeof(address));
+		}
+
+		return key;
+	}
+
+	// ns per Check of the keys, cycling over them
+	int64_t CheckCost(const std::vector<RateLimiter::Key>& keys, size_t nbChecks)
+	{
+		RateLimiter::Config config;
+		config.messages = { 1e9, 1e9, RateLimiter::Action::Delay };
+
+		RateLimiter limiter(config);
+		const Bench::Clock::time_point start = Bench::Clock::now();
+
+		for (size_t i = 0; i < nbChecks; i++)
+			limiter.Check(keys[i % keys.size()], RateLimiter::Bucket::Messages, 1);
+
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now() - start).count() / static_cast<int64_t>(nbChecks);
+	}
+
+	// Messages accepted out of big messages over the bytes limit then smalls, a messages burst of smalls.
+	// A big one refused on its size must not use up a message token or the small ones are refused
+	size_t AfterBigRefused(size_t bigs, size_t smalls)
+	{
+		RateLimiter::Config config;
+		// Not refilled during the run
+		config.messages = { 1e-3, static_cast<double>(smalls), RateLimiter::Action::Reject };
+		config.bytes = { 1e-3, 1024, RateLimiter::Action::Reject };
+
+		RateLimiter limiter(config);
+
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return 0;
+
+		size_t accepted = 0;
+		{
+			Session session(fds[0], Endpoint{}, 0, &limiter, nullptr, Session::Batching());
+
+			for (size_t i = 0; i < bigs + smalls; i++)
+			{
+				if (not Bench::SendString(fds[1], std::string(i < bigs ? 2048 : 16, 'x')))
+					break;
+
+				try
+				{
+					std::string message;
+					session.RecvString(&message);
+					accepted++;
+				}
+				catch (const Session::Rejected&)
+				{
+				}
+			}
+		}
+
+		close(fds[1]);
+		return accepted;
+	}
+
+	// Well-behaved clients, each on its own IP, one session every period until Stop
+	class Paced {
+
+	public:
+
+		void Start(const Bench::Target& target, size_t nbClients, std::chrono::milliseconds period)
+		{
+			running.store(true);
+			sources.resize(nbClients);
+			latencies.resize(nbClients);
+
+			for (size_t i = 0; i < nbClients; i++)
+			{
+				sources[i] = "127.0.1." + std::to_string(i % 250 + 1);
+
+				clients.emplace_back([this, &target, period, i]() {
+					// Spread the first sessions over the period
+					Bench::Clock::time_point next = Bench::Clock::now() + period * static_cast<int64_t>(i) / static_cast<int64_t>(sources.size());
+
+					while (running.load())
+					{
+						std::this_thread::sleep_until(next);
+						next += period;
+						latencies[i].push_back(Bench::Exchange(target, sources[i].c_str()));
+					}
+				});
+			}
+		}
+
+		// Join the clients, latencies in us & the nb of failed sessions
+		size_t Stop(Bench::Samples* samples)
+		{
+			running.store(false);
+
+			for (auto& client : clients)
+				client.join();
+
+			size_t failed = 0;
+
+			for (const auto& client : latencies)
+			{
+				for (int64_t latency : client)
+				{
+					if (latency < 0)
+						failed++;
+					else
+						samples->Add(latency);
+				}
+			}
+
+			clients.clear();
+			latencies.clear();
+			return failed;
+		}
+
+	private:
+
+		std::atomic_bool running{ false };
+		std::vector<std::string> sources;
+		std::vector<std::thread> clients;
+		std::vector<std::vector<int64_t>> latencies;
+	};
+}
+
+int Bench::Limiter(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbWorkers = static_cast<size_t>(Option(argc, argv, "--workers", 2));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 100));
+	const size_t nbAbusers = static_cast<size_t>(Option(argc, argv, "--abusers", 16));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 3000));
+
+	// ================== Cost of a check ==================
+	{
+		const size_t nbChecks = 2000000;
+		std::vector<RateLimiter::Key> keys;
+
+		Out() << "[BENCH] : Check cost, " << nbChecks << " checks" << std::endl;
+
+		keys = { MakeKey(1, false, 0) };
+		Out() << "  1 client: " << CheckCost(keys, nbChecks) << " ns" << std::endl;
+
+		keys.clear();
+		for (uint32_t i = 0; i < 100000; i++)
+			keys.push_back(MakeKey(i, false, 0));
+		Out() << "  100k IPv4 clients: " << CheckCost(keys, nbChecks) << " ns" << std::endl;
+
+		// Over the 64 x 4096 clients of the table, the new ones share the overflow buckets
+		keys.clear();
+		for (uint32_t i = 0; i < 1000000; i++)
+			keys.push_back(MakeKey(i, false, 0));
+		Out() << "  1M IPv4 clients (table full): " << CheckCost(keys, nbChecks) << " ns" << std::endl;
+
+		// One /64, every address is the same client
+		keys.clear();
+		for (uint64_t i = 0; i < 100000; i++)
+			keys.push_back(MakeKey(1, true, i * 0x9E3779B97F4A7C15ull));
+		Out() << "  100k IPv6 addresses of one /64: " << CheckCost(keys, nbChecks) << " ns" << std::endl;
+	}
+
+	// ================== Message tokens of the refused messages ==================
+	const size_t accepted = AfterBigRefused(4, 4);
+	Out() << "[BENCH] : 4 messages of 2 KiB over a 1 KiB bytes limit then 4 of 16 B, 4 message tokens: " << accepted << " of the 4 small ones accepted" << std::endl;
+
+	if (accepted != 4)
+		return EXIT_FAILURE;
+
+	// ================== Fairness ==================
+	Target target;
+	if (Resolve("127.0.0.1", port, &target) < 0)
+		return EXIT_FAILURE;
+
+	// The demo limits of the server: the well-behaved clients stay under them
+	RateLimiter::Config limits;
+	limits.connections = { 20, 40, RateLimiter::Action::Delay };
+	limits.messages = { 200, 400, RateLimiter::Action::Delay };
+
+	Out() << "[BENCH] : " << nbClients << " clients at 10 sessions/s each, " << nbWorkers << " workers, connections limited to 20/s per IP (Delay)" << std::endl;
+
+	for (size_t abusers : { size_t(0), nbAbusers })
+	{
+		Server server(port, nbWorkers, limits);
+
+		if (server.Start() < 0)
+			return EXIT_FAILURE;
+
+		// Start only spawns the listener
+		while (Exchange(target) < 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		Load abuser;
+		if (abusers > 0)
+			abuser.Start(target, abusers, ABUSER_IP);
+
+		Paced paced;
+		paced.Start(target, nbClients, std::chrono::milliseconds(100));
+		std::this_thread::sleep_for(duration);
+
+		Samples samples;
+		const size_t failed = paced.Stop(&samples);
+
+		size_t abuserDone = 0, abuserFailed = 0;
+		for (const auto& result : abuser.Stop())
+		{
+			if (result.latency < 0)
+				abuserFailed++;
+			else
+				abuserDone++;
+		}
+
+		server.Stop();
+
+		Out() << "  " << abusers << " abusive threads from " << ABUSER_IP << ": " << abuserDone << " served, " << abuserFailed << " failed" << std::endl;
+		Out() << "  well-behaved refused/dropped: " << failed << std::endl;
+		Report("well-behaved", samples);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+#include "Bench.hpp"
+
+#include <map>
+#include <cstdlib>
+#include <sched.h>
+
+#include "../Server/Server.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	// The allowed CPUs dealt round robin to nbNodes fake nodes, as numactl would show them on a NUMA machine
+	std::map<int, std::vector<int>> SimulateNodes(size_t nbNodes)
+	{
+		std::map<int, std::vector<int>> nodes;
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		sched_getaffinity(0, sizeof(allowed), &allowed);
+
+		size_t i = 0;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if (CPU_ISSET(cpu, &allowed))
+				nodes[static_cast<int>(i++ % nbNodes)].push_back(cpu);
+		}
+
+		return nodes;
+	}
+
+	std::string Cpus(const std::vector<int>& cpus)
+	{
+		if (cpus.empty())
+			return "any";
+
+		std::string list;
+		for (int cpu : cpus)
+			list += (list.empty() ? "" : ",") + std::to_string(cpu);
+
+		return list;
+	}
+
+	// Closed loop load against a server placed by the topology
+	int Run(const char* name, const Topology& topology, uint16_t port, size_t nbWorkers, size_t nbClients, std::chrono::milliseconds duration)
+	{
+		Bench::Target target;
+		if (Bench::Resolve("127.0.0.1", port, &target) < 0)
+			return -1;
+
+		Server server(port, nbWorkers);
+
+		if (server.SetTopology(topology) < 0 || server.Start() < 0)
+			return -1;
+
+		// Start only spawns the listener
+		while (Bench::Exchange(target) < 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		Bench::Load load;
+		load.Start(target, nbClients);
+		std::this_thread::sleep_for(duration);
+
+		Bench::Samples samples;
+		size_t failed = 0;
+
+		for (const auto& result : load.Stop())
+		{
+			if (result.latency < 0)
+				failed++;
+			else
+				samples.Add(result.latency);
+		}
+
+		server.Stop();
+
+		Bench::Out() << "[BENCH] : " << name << ", listener on " << Cpus(topology.listenerCpus) << ", workers on " << Cpus(topology.workerCpus) << std::endl;
+		Bench::Out() << "  refused/dropped: " << failed << ", sessions/s: " << samples.Count() * 1000 / static_cast<size_t>(duration.count()) << std::endl;
+		Bench::Report("session", samples);
+		return 0;
+	}
+}
+
+int Bench::Pin(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbWorkers = static_cast<size_t>(Option(argc, argv, "--workers", 2));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 16));
+	const size_t nbNodes = static_cast<size_t>(Option(argc, argv, "--nodes", 2));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 2000));
+
+	if (nbNodes == 0)
+	{
+		Out() << "[BENCH] : --nodes must be at least 1" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (Run("Unpinned", Topology(), port, nbWorkers, nbClients, duration) < 0)
+		return EXIT_FAILURE;
+
+	if (Run("Pinned on the nodes of the machine", Topologies::Spread(nbWorkers), port, nbWorkers, nbClients, duration) < 0)
+		return EXIT_FAILURE;
+
+	const std::string simulated = "Pinned on " + std::to_string(nbNodes) + " simulated nodes";
+
+	if (Run(simulated.c_str(), Topologies::Spread(nbWorkers, SimulateNodes(nbNodes)), port, nbWorkers, nbClients, duration) < 0)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,263 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+
+#include "../Server/Server.hpp"
+#include "../Client/ConnectionPool.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	// Keeps its connections open: answers every string with the same string until the client closes
+	class EchoServer {
+
+	public:
+
+		explicit EchoServer(uint16_t port)
+		{
+			listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+			int opt = 1;
+			setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+			struct sockaddr_in6 addr {};
+			addr.sin6_family = AF_INET6;
+			addr.sin6_port = htons(port);
+			addr.sin6_addr = in6addr_any;
+
+			bind(listenFd, (struct sockaddr*)&addr, sizeof(addr));
+			listen(listenFd, SOMAXCONN);
+
+			acceptor = std::thread([this]() {
+				while (running.load())
+				{
+					struct pollfd pfd { listenFd, POLLIN, 0 };
+
+					if (poll(&pfd, 1, 50) <= 0)
+						continue;
+
+					int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+
+					if (fd < 0)
+						continue;
+
+					std::unique_lock<std::mutex> lock(guardConnections);
+					connections.emplace_back([fd]() {
+						std::string message;
+
+						while (Bench::RecvString(fd, &message) && Bench::SendString(fd, message)) {}
+
+						close(fd);
+					});
+				}
+			});
+		}
+
+		// The clients must have closed their connections
+		~EchoServer()
+		{
+			running.store(false);
+			acceptor.join();
+			close(listenFd);
+
+			for (auto& connection : connections)
+				connection.join();
+		}
+
+	private:
+
+		int listenFd;
+		std::atomic_bool running{ true };
+		std::thread acceptor;
+
+		std::mutex guardConnections;
+		std::vector<std::thread> connections;
+	};
+
+	struct Result {
+		Bench::Samples latencies;
+		std::atomic<size_t> failed{ 0 };
+		// Calls of the request, above the nb of requests when some were retried
+		std::atomic<size_t> attempts{ 0 };
+	};
+
+	// nbClients threads sending requests for duration, through run(request) that returns false on failure
+	template <typename Fn>
+	void Drive(size_t nbClients, std::chrono::milliseconds duration, Result* result, Fn run)
+	{
+		std::atomic_bool running{ true };
+		std::vector<std::thread> clients;
+
+		for (size_t i = 0; i < nbClients; i++)
+		{
+			clients.emplace_back([&]() {
+				std::vector<int64_t> latencies;
+
+				while (running.load())
+				{
+					const Bench::Clock::time_point start = Bench::Clock::now();
+
+					if (run())
+						latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Bench::Clock::now() - start).count());
+					else
+						result->failed++;
+				}
+
+				result->latencies.Add(latencies);
+			});
+		}
+
+		std::this_thread::sleep_for(duration);
+		running.store(false);
+
+		for (auto& client : clients)
+			client.join();
+	}
+
+	void Print(const char* name, Result& result)
+	{
+		Bench::Out() << "  " << name << ": failed " << result.failed.load() << ", attempts " << result.attempts.load() << std::endl;
+		Bench::Report("  request", result.latencies);
+	}
+}
+
+int Bench::Pool(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 4));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 2000));
+	const std::string host = "127.0.0.1", service = std::to_string(port);
+
+	auto exchange = [](ClientSocket& socket, Result* result) {
+		result->attempts++;
+
+		std::string reply;
+		socket.SendString(HELLO);
+		socket.RecvString(&reply);
+	};
+
+	// ================== Connections kept by the server ==================
+	{
+		EchoServer echo(port);
+
+		Out() << "[BENCH] : Echo server keeping the connections, " << nbClients << " clients" << std::endl;
+
+		Result fresh;
+		Drive(nbClients, duration, &fresh, [&]() {
+			try
+			{
+				ClientSocket socket(host, service);
+				exchange(socket, &fresh);
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		});
+		Print("new connection per request", fresh);
+
+		ConnectionPool pool;
+		Result pooled;
+		Drive(nbClients, duration, &pooled, [&]() {
+			try
+			{
+				pool.Run(host, service, [&](ClientSocket& socket) { exchange(socket, &pooled); });
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		});
+		Print("pooled", pooled);
+		pool.Clear();
+	}
+
+	// ================== Connections closed by the server ==================
+	// The demo handler ends the session after one reply, an idle connection is closed
+	// while it sits in the pool & its FIN races the health check of the next Acquire
+	{
+		Server server(port, 2);
+
+		if (server.Start() < 0)
+			return EXIT_FAILURE;
+
+		Out() << "[BENCH] : Server closing after each reply, " << nbClients << " clients" << std::endl;
+
+		ConnectionPool pool;
+		Result acquired;
+		Drive(nbClients, duration, &acquired, [&]() {
+			try
+			{
+				ConnectionPool::Lease lease = pool.Acquire(host, service);
+
+				try
+				{
+					exchange(*lease, &acquired);
+					return true;
+				}
+				catch (const std::exception&)
+				{
+					lease.MarkBroken();
+					return false;
+				}
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		});
+		Print("Acquire, no retry", acquired);
+
+		Result retried;
+		Drive(nbClients, duration, &retried, [&]() {
+			try
+			{
+				pool.Run(host, service, [&](ClientSocket& socket) { exchange(socket, &retried); });
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		});
+		Print("Run, retried once on a new connection", retried);
+		pool.Clear();
+
+		server.Stop();
+	}
+
+	// ================== Server down ==================
+	// Plain connect by default: Acquire sees the refused connect & backs off, it must throw
+	{
+		ConnectionPool::Config config;
+		config.maxAttempts = 3;
+		config.baseBackoff = std::chrono::milliseconds(10);
+
+		ConnectionPool pool(config);
+		const Clock::time_point start = Clock::now();
+		bool thrown = false;
+
+		try
+		{
+			pool.Acquire(host, service);
+		}
+		catch (const std::exception&)
+		{
+			thrown = true;
+		}
+
+		Out() << "[BENCH] : Server down, " << config.maxAttempts << " attempts: " << (thrown ? "Acquire threw" : "Acquire RETURNED") << " after "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count() << " ms" << std::endl;
+
+		if (not thrown)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include "../Server/Server.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	// TcpExt counter of /proc/net/netstat, 0 if unknown
+	uint64_t ReadTcpExt(const std::string& name)
+	{
+		std::ifstream netstat("/proc/net/netstat");
+		std::string names, values;
+
+		// Pairs of lines: "TcpExt: names..." then "TcpExt: values..."
+		while (std::getline(netstat, names) && std::getline(netstat, values))
+		{
+			if (names.compare(0, 7, "TcpExt:") != 0)
+				continue;
+
+			std::istringstream n(names), v(values);
+			std::string key, value;
+
+			while (n >> key && v >> value)
+			{
+				if (key == name)
+					return std::stoull(value);
+			}
+		}
+
+		return 0;
+	}
+}
+
+int Bench::Profiles(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 16));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 1000));
+
+	const SocketProfile profiles[] = { SocketProfile::Default, SocketProfile::LowLatency, SocketProfile::BulkThroughput, SocketProfile::ManyIdle };
+	const std::string messages[] = { HELLO, std::string(1024 * 1024, 'x') };
+
+	Out() << "[BENCH] : " << nbClients << " clients, 2 workers, " << duration.count() << " ms per run" << std::endl;
+	Out() << "  profile         message  fastopen  sessions/s       p50       p99  fastopen accepted" << std::endl;
+
+	for (SocketProfile profile : profiles)
+	{
+		for (const std::string& message : messages)
+		{
+			for (bool fastOpen : { false, true })
+			{
+				Target target;
+				if (Resolve("127.0.0.1", port, &target) < 0)
+					return EXIT_FAILURE;
+
+				target.fastOpen = fastOpen;
+
+				Server server(port, 2, RateLimiter::Config(), profile);
+
+				if (server.Start() < 0)
+					return EXIT_FAILURE;
+
+				// One session to get the fast open cookie before measuring
+				Exchange(target);
+				const uint64_t passive = ReadTcpExt("TCPFastOpenPassive");
+
+				Load load;
+				load.Start(target, nbClients, nullptr, message);
+				std::this_thread::sleep_for(duration);
+
+				Samples samples;
+				for (const auto& result : load.Stop())
+				{
+					if (result.latency >= 0)
+						samples.Add(result.latency);
+				}
+
+				server.Stop();
+
+				Out() << "  " << std::left << std::setw(16) << SocketProfiles::GetName(profile) << std::setw(9) << (message.size() > HELLO.size() ? "1 MiB" : "18 B")
+					<< std::setw(10) << (fastOpen ? "on" : "off") << std::right << std::setw(10) << samples.Count() * 1000 / static_cast<size_t>(duration.count())
+					<< std::setw(8) << samples.Percentile(0.50) << " us" << std::setw(7) << samples.Percentile(0.99) << " us"
+					<< std::setw(19) << ReadTcpExt("TCPFastOpenPassive") - passive << std::endl;
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+#include "Bench.hpp"
+
+#include <memory>
+#include <random>
+#include <ctime>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "../Server/Slab.hpp"
+#include "../Server/Session.hpp"
+#include "../Server/SessionRegistry.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	int64_t SteadyNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now().time_since_epoch()).count();
+	}
+
+	// A worker echoing the messages of one session on a socketpair while a client sends them
+	// Return the round trips per second
+	int64_t EchoRate(Session& session, int client, std::chrono::milliseconds duration)
+	{
+		std::thread worker([&session]() {
+			try
+			{
+				std::string message;
+
+				while (true)
+				{
+					session.RecvString(&message);
+					session.SendString(message);
+				}
+			}
+			catch (const std::exception&)
+			{
+				// The client sent the empty message that ends the run
+			}
+		});
+
+		const std::string message(64, 'x');
+		std::string reply;
+		int64_t nbOfRoundTrips = 0;
+		const Bench::Clock::time_point start = Bench::Clock::now();
+
+		while (Bench::Clock::now() - start < duration)
+		{
+			if (not Bench::SendString(client, message) || not Bench::RecvString(client, &reply))
+				break;
+
+			nbOfRoundTrips++;
+		}
+
+		const int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Bench::Clock::now() - start).count();
+		// Ends the RecvString loop of the worker
+		shutdown(client, SHUT_WR);
+		worker.join();
+
+		return nbOfRoundTrips * 1000000 / std::max<int64_t>(elapsed, 1);
+	}
+}
+
+int Bench::Registry(int argc, char** argv)
+{
+	const size_t nbSessions = static_cast<size_t>(Option(argc, argv, "--sessions", 50000));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 2000));
+
+	if (nbSessions == 0)
+	{
+		Out() << "[BENCH] : --sessions must be at least 1" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// ================== Sessions without socket (fd -1) ==================
+	Slab<Session> slab(nbSessions + 2);
+	SessionRegistry registry;
+
+	// Read by the admin thread, stale ids are expected and must be refused
+	std::unique_ptr<std::atomic<uint64_t>[]> ids(new std::atomic<uint64_t>[nbSessions]);
+
+	for (size_t i = 0; i < nbSessions; i++)
+	{
+		const uint64_t id = slab.Create(-1, Endpoint{}, SteadyNs(), nullptr, nullptr, Session::Batching());
+		registry.Register(id, slab.Get(id));
+		ids[i].store(id);
+	}
+
+	// ================== The measured session on a socketpair ==================
+	auto EchoSession = [&slab, &registry](int* client) -> uint64_t {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+			return Slab<Session>::INVALID;
+
+		*client = fds[1];
+		const uint64_t id = slab.Create(fds[0], Endpoint{}, SteadyNs(), nullptr, nullptr, Session::Batching());
+		registry.Register(id, slab.Get(id));
+		return id;
+	};
+
+	Out() << "[BENCH] : " << nbSessions << " sessions registered, echo of 64 B on a socketpair for " << duration.count() << " ms" << std::endl;
+
+	// ================== Cost of the activity stamps ==================
+	{
+		struct timespec now {};
+		const size_t nbOfReads = 1000000;
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < nbOfReads; i++)
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		const int64_t precise = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / static_cast<int64_t>(nbOfReads);
+
+		start = Clock::now();
+		for (size_t i = 0; i < nbOfReads; i++)
+			clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+		const int64_t coarse = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / static_cast<int64_t>(nbOfReads);
+
+		Out() << "  clock read: " << precise << " ns precise, " << coarse << " ns coarse (one per recv & send)" << std::endl;
+	}
+
+	int client = -1;
+	uint64_t echo = EchoSession(&client);
+
+	if (echo == Slab<Session>::INVALID)
+		return EXIT_FAILURE;
+
+	const int64_t alone = EchoRate(*slab.Get(echo), client, duration);
+	registry.Unregister(echo);
+	slab.Destroy(echo);
+	close(client);
+
+	Out() << "  data path alone: " << alone << " round trips/s" << std::endl;
+
+	// ================== Two busy threads that never touch the registry ==================
+	// The share of the CPU they take is not an overhead of the registry
+	{
+		std::atomic_bool busy{ true };
+		std::vector<std::thread> spinners;
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			spinners.emplace_back([&busy]() {
+				volatile uint64_t sink = 0;
+				while (busy.load(std::memory_order_relaxed))
+					sink = sink + 1;
+			});
+		}
+
+		echo = EchoSession(&client);
+
+		if (echo == Slab<Session>::INVALID)
+			return EXIT_FAILURE;
+
+		const int64_t shared = EchoRate(*slab.Get(echo), client, duration);
+		busy.store(false);
+
+		for (auto& spinner : spinners)
+			spinner.join();
+
+		registry.Unregister(echo);
+		slab.Destroy(echo);
+		close(client);
+
+		Out() << "  data path with 2 busy threads: " << shared << " round trips/s (" << (alone > 0 ? (alone - shared) * 100 / alone : 0) << "% slower)" << std::endl;
+	}
+
+	// ================== Churn & admin calls meanwhile ==================
+	std::atomic_bool running{ true };
+	std::atomic<uint64_t> nbOfChurned{ 0 }, nbOfLists{ 0 }, nbOfQueries{ 0 }, nbOfFound{ 0 }, nbOfKills{ 0 }, nbOfSent{ 0 };
+	Samples lists;
+
+	// Ends sessions & starts new ones in their slots, the old ids go stale
+	std::thread churn([&]() {
+		std::mt19937_64 random(1);
+
+		while (running.load())
+		{
+			const size_t i = random() % nbSessions;
+			const uint64_t old = ids[i].load();
+
+			registry.Unregister(old);
+			slab.Destroy(old);
+
+			const uint64_t id = slab.Create(-1, Endpoint{}, SteadyNs(), nullptr, nullptr, Session::Batching());
+			registry.Register(id, slab.Get(id));
+			ids[i].store(id);
+
+			nbOfChurned++;
+		}
+	});
+
+	// List now & then, Query, SendTo & Kill random ids in between
+	std::thread admin([&]() {
+		std::mt19937_64 random(2);
+		SessionRegistry::Info info;
+
+		while (running.load())
+		{
+			const Clock::time_point start = Clock::now();
+			registry.List();
+			lists.Add(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+			nbOfLists++;
+
+			for (size_t i = 0; i < 1000 && running.load(); i++)
+			{
+				const uint64_t id = ids[random() % nbSessions].load();
+
+				nbOfFound += registry.Query(id, &info) ? 1 : 0;
+				nbOfQueries++;
+
+				if (i % 10 == 0)
+					nbOfSent += registry.SendTo(id, "admin") ? 1 : 0;
+
+				if (i % 100 == 0)
+					nbOfKills += registry.Kill(id) ? 1 : 0;
+			}
+		}
+	});
+
+	echo = EchoSession(&client);
+
+	if (echo == Slab<Session>::INVALID)
+		return EXIT_FAILURE;
+
+	const int64_t loaded = EchoRate(*slab.Get(echo), client, duration);
+
+	running.store(false);
+	churn.join();
+	admin.join();
+
+	registry.Unregister(echo);
+	slab.Destroy(echo);
+	close(client);
+
+	Out() << "  data path with churn & admin: " << loaded << " round trips/s (" << (alone > 0 ? (alone - loaded) * 100 / alone : 0) << "% slower)" << std::endl;
+	Out() << "  churned: " << nbOfChurned.load() << " sessions, queries: " << nbOfQueries.load() << " (" << nbOfFound.load() << " found), sent: "
+		<< nbOfSent.load() << ", killed: " << nbOfKills.load() << ", registered at the end: " << registry.Size() << std::endl;
+
+	Out() << "  list of " << nbSessions << ": " << nbOfLists.load() << " lists, p50: " << lists.Percentile(0.5) << " us, max: " << lists.Percentile(1.0) << " us" << std::endl;
+
+	for (size_t i = 0; i < nbSessions; i++)
+	{
+		registry.Unregister(ids[i].load());
+		slab.Destroy(ids[i].load());
+	}
+
+	// Every session was unregistered, a leak or a double registration shows here
+	return registry.Size() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
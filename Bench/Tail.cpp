@@ -0,0 +1,377 @@
+#include "Bench.hpp"
+
+#include <cstdlib>
+#include <queue>
+#include <random>
+#include <condition_variable>
+#include <unordered_map>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+
+#include "../Server/Server.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	// Sent by the slow sessions, the others send Bench::HELLO
+	const std::string SLOW = "SLOW";
+
+	// Share of the sessions whose handler takes slow before it replies.
+	// The handler sleeps: the worker is held like by a computation but the only CPU of
+	// a small VM is not, so the queueing of the scheduler shows & not the CPU contention
+	struct Mix {
+		uint32_t slowPercent;
+		std::chrono::milliseconds slow;
+	};
+
+	// The demo exchange, slow for the SLOW messages
+	void Handle(Session& session, const Mix& mix)
+	{
+		std::string message;
+		session.RecvString(&message);
+
+		if (message == SLOW)
+			std::this_thread::sleep_for(mix.slow);
+
+		session.SendString("Hello from Server !");
+	}
+
+	// Latencies of the cheap & the slow sessions, apart so the cheap ones stuck behind a slow one show
+	struct Results {
+		Bench::Samples cheap;
+		Bench::Samples slow;
+		size_t failed = 0;
+	};
+
+	// The model before the work stealing deques: one std::queue shared by the listener & all the
+	// workers, each worker runs the same handler on a Session
+	class SharedQueueServer {
+
+	public:
+
+		explicit SharedQueueServer(uint16_t port, size_t nbWorkers, const Mix& mix) : mix(mix)
+		{
+			listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+			int opt = 1;
+			setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+			struct sockaddr_in6 addr {};
+			addr.sin6_family = AF_INET6;
+			addr.sin6_port = htons(port);
+			addr.sin6_addr = in6addr_any;
+
+			listening = bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) == 0 && listen(listenFd, SOMAXCONN) == 0;
+
+			for (size_t i = 0; listening && i < nbWorkers; i++)
+				workers.emplace_back(&SharedQueueServer::Worker, this);
+
+			if (listening)
+				acceptor = std::thread(&SharedQueueServer::Accept, this);
+		}
+
+		~SharedQueueServer()
+		{
+			{
+				std::unique_lock<std::mutex> lock(guardQueue);
+				running = false;
+				wake.notify_all();
+			}
+
+			if (acceptor.joinable())
+				acceptor.join();
+
+			for (auto& worker : workers)
+				worker.join();
+
+			while (not queue.empty())
+			{
+				close(queue.front());
+				queue.pop();
+			}
+
+			close(listenFd);
+		}
+
+		bool IsListening() const
+		{
+			return listening;
+		}
+
+	private:
+
+		const Mix mix;
+		int listenFd;
+		bool listening;
+		bool running = true;
+
+		std::mutex guardQueue;
+		std::condition_variable wake;
+		std::queue<int> queue;
+
+		std::thread acceptor;
+		std::vector<std::thread> workers;
+
+		void Accept()
+		{
+			struct pollfd pfd { listenFd, POLLIN, 0 };
+
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(guardQueue);
+					if (not running)
+						return;
+				}
+
+				if (poll(&pfd, 1, 50) <= 0)
+					continue;
+
+				int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+
+				if (fd < 0)
+					continue;
+
+				std::unique_lock<std::mutex> lock(guardQueue);
+				queue.push(fd);
+				wake.notify_one();
+			}
+		}
+
+		void Worker()
+		{
+			while (true)
+			{
+				int fd = -1;
+				{
+					std::unique_lock<std::mutex> lock(guardQueue);
+					wake.wait(lock, [this]() { return not running || not queue.empty(); });
+
+					if (not running)
+						return;
+
+					fd = queue.front();
+					queue.pop();
+				}
+
+				// Closes fd
+				Session session(fd, Endpoint{}, 0, nullptr, nullptr, Session::Batching());
+
+				try
+				{
+					Handle(session, mix);
+					session.Flush();
+				}
+				catch (const std::exception&)
+				{
+				}
+			}
+		}
+	};
+
+	// Reset instead of TIME_WAIT so the ephemeral ports last the whole run
+	void Abort(int fd)
+	{
+		struct linger abort { 1, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+		close(fd);
+	}
+
+	// Closed loop: nbClients threads running one session after the other for duration
+	void ClosedLoop(const Bench::Target& target, size_t nbClients, std::chrono::milliseconds duration, const Mix& mix, Results* results)
+	{
+		std::atomic_bool running{ true };
+		std::atomic<size_t> failed{ 0 };
+		std::vector<std::thread> clients;
+
+		for (size_t i = 0; i < nbClients; i++)
+		{
+			clients.emplace_back([&, i]() {
+				std::minstd_rand random(static_cast<uint32_t>(i + 1));
+				std::vector<int64_t> cheap, slow;
+
+				while (running.load())
+				{
+					const bool isSlow = random() % 100 < mix.slowPercent;
+					const Bench::Clock::time_point start = Bench::Clock::now();
+					int fd = Bench::Connect(target);
+
+					if (fd < 0)
+					{
+						failed++;
+						continue;
+					}
+
+					std::string reply;
+					const bool ok = Bench::SendString(fd, isSlow ? SLOW : Bench::HELLO) && Bench::RecvString(fd, &reply);
+					Abort(fd);
+
+					if (not ok)
+						failed++;
+					else
+						(isSlow ? slow : cheap).push_back(std::chrono::duration_cast<std::chrono::microseconds>(Bench::Clock::now() - start).count());
+				}
+
+				results->cheap.Add(cheap);
+				results->slow.Add(slow);
+			});
+		}
+
+		std::this_thread::sleep_for(duration);
+		running.store(false);
+
+		for (auto& client : clients)
+			client.join();
+
+		results->failed += failed.load();
+	}
+
+	// Open loop: a new session every 1/rate s whatever the server does, the deques grow when it falls behind.
+	// Latency of every session from its connect to the reply
+	void OpenLoop(const Bench::Target& target, size_t rate, std::chrono::milliseconds duration, const Mix& mix, Results* results)
+	{
+		struct Waiting {
+			Bench::Clock::time_point connected;
+			bool slow;
+		};
+
+		std::unordered_map<int, Waiting> waiting;
+		std::minstd_rand random(1);
+
+		int epfd = epoll_create1(EPOLL_CLOEXEC);
+		const auto interval = std::chrono::nanoseconds(1000000000 / rate);
+		const Bench::Clock::time_point start = Bench::Clock::now();
+		Bench::Clock::time_point next = start;
+
+		while (next < start + duration || not waiting.empty())
+		{
+			// ================== Start the sessions due ==================
+			while (next < start + duration && next <= Bench::Clock::now())
+			{
+				const bool isSlow = random() % 100 < mix.slowPercent;
+				const Bench::Clock::time_point connected = Bench::Clock::now();
+				int fd = Bench::Connect(target);
+
+				if (fd < 0 || not Bench::SendString(fd, isSlow ? SLOW : Bench::HELLO))
+				{
+					results->failed++;
+					if (fd >= 0)
+						close(fd);
+				}
+				else
+				{
+					struct epoll_event event {};
+					event.events = EPOLLIN;
+					event.data.fd = fd;
+					epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+					waiting.emplace(fd, Waiting{ connected, isSlow });
+				}
+
+				next += interval;
+			}
+
+			// ================== Collect the replies ==================
+			struct epoll_event events[256];
+			// Sleep until the next session is due (1 ms at most, the sessions then start by small bursts)
+			int timeout = next >= start + duration ? 1000 : next > Bench::Clock::now() ? 1 : 0;
+			int nb = epoll_wait(epfd, events, 256, timeout);
+
+			for (int i = 0; i < nb; i++)
+			{
+				const int fd = events[i].data.fd;
+				const Waiting session = waiting[fd];
+				std::string reply;
+
+				if (Bench::RecvString(fd, &reply))
+					(session.slow ? results->slow : results->cheap).Add(std::chrono::duration_cast<std::chrono::microseconds>(Bench::Clock::now() - session.connected).count());
+				else
+					results->failed++;
+
+				waiting.erase(fd);
+				Abort(fd);
+			}
+
+			// No reply for a second after the last session started, the rest is lost
+			if (nb == 0 && next >= start + duration)
+				break;
+		}
+
+		for (const auto& session : waiting)
+		{
+			results->failed++;
+			close(session.first);
+		}
+
+		close(epfd);
+	}
+}
+
+int Bench::Tail(int argc, char** argv)
+{
+	const uint16_t port = static_cast<uint16_t>(Option(argc, argv, "--port", 14105));
+	const size_t nbWorkers = static_cast<size_t>(Option(argc, argv, "--workers", 2));
+	const size_t nbClients = static_cast<size_t>(Option(argc, argv, "--clients", 64));
+	const size_t rate = static_cast<size_t>(Option(argc, argv, "--rate", 0));
+	const auto duration = std::chrono::milliseconds(Option(argc, argv, "--ms", 3000));
+
+	Mix mix;
+	mix.slowPercent = static_cast<uint32_t>(std::min<long>(Option(argc, argv, "--slow", 10), 100));
+	mix.slow = std::chrono::milliseconds(Option(argc, argv, "--slow-ms", 50));
+
+	Target target;
+	if (Resolve("127.0.0.1", port, &target) < 0)
+		return EXIT_FAILURE;
+
+	if (rate > 0)
+		Out() << "[BENCH] : Open loop at " << rate << " sessions/s, " << nbWorkers << " workers for " << duration.count() << " ms";
+	else
+		Out() << "[BENCH] : " << nbClients << " clients, " << nbWorkers << " workers for " << duration.count() << " ms";
+
+	Out() << ", " << mix.slowPercent << "% of the handlers take " << mix.slow.count() << " ms" << std::endl;
+
+	auto Run = [&](Results* results) {
+		if (rate > 0)
+			OpenLoop(target, rate, duration, mix, results);
+		else
+			ClosedLoop(target, nbClients, duration, mix, results);
+	};
+
+	auto Print = [&](const char* name, Results& results) {
+		Out() << "  " << name << ": refused/dropped: " << results.failed << ", sessions/s: " << (results.cheap.Count() + results.slow.Count()) * 1000 / static_cast<size_t>(duration.count()) << std::endl;
+		Report("  cheap session", results.cheap);
+
+		if (results.slow.Count() > 0)
+			Report("  slow session", results.slow);
+	};
+
+	// ================== Work stealing deques ==================
+	Results stealing;
+	{
+		Server server(port, nbWorkers);
+		server.SetHandler([&mix](Session& session) { Handle(session, mix); });
+
+		if (server.Start() < 0)
+			return EXIT_FAILURE;
+
+		Run(&stealing);
+		server.Stop();
+	}
+	Print("work stealing deques", stealing);
+
+	// ================== Shared queue (before) ==================
+	Results shared;
+	{
+		SharedQueueServer server(port, nbWorkers, mix);
+
+		if (not server.IsListening())
+			return EXIT_FAILURE;
+
+		Run(&shared);
+	}
+	Print("shared queue", shared);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <signal.h>
+
+#include "Bench.hpp"
+
+using namespace TCPMachine;
+
+namespace {
+
+	struct Scenario {
+		const char* name;
+		int (*run)(int argc, char** argv);
+		const char* description;
+	};
+
+	const Scenario SCENARIOS[] = {
+		{ "hotrestart", Bench::HotRestart, "refusals & latency during a listener hand off vs a cold restart" },
+		{ "tail", Bench::Tail, "latency percentiles with more clients than workers" },
+		{ "accept", Bench::Accept, "peer lookup cost & connection churn" },
+		{ "profiles", Bench::Profiles, "socket profile x message size x fast open matrix" },
+		{ "fanout", Bench::Fanout, "publish to 10k subscribers while subscribing" },
+		{ "pool", Bench::Pool, "pooled vs new connections, reuse of closed connections" },
+		{ "pin", Bench::Pin, "unpinned vs pinned workers on real & simulated NUMA nodes" },
+		{ "footprint", Bench::Footprint, "memory & create/destroy rate of 100k sessions" },
+		{ "registry", Bench::Registry, "admin calls on 50k churning sessions & their cost on the data path" },
+		{ "limiter", Bench::Limiter, "rate limit check cost & fairness of 100 clients vs 1 abusive" },
+		{ "decoder", Bench::Decoder, "RecvString throughput from 16 B to 1 MiB frames" },
+		{ "batching", Bench::Batching, "replies vs the overflow policy, latency & sends at 0/50/500 us budgets" },
+		{ "capture", Bench::Capture, "full log truncation, throughput with the capture off vs on" },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " <scenario> [--option value...] [--verbose]" << std::endl;
+
+		for (const Scenario& scenario : SCENARIOS)
+			std::cerr << "  " << scenario.name << ": " << scenario.description << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	// A client closing early must not kill the bench
+	signal(SIGPIPE, SIG_IGN);
+
+	// Bind the results stream before the logs of the server are muted
+	Bench::Out();
+
+	if (not Bench::Flag(argc, argv, "--verbose"))
+	{
+		std::cout.rdbuf(nullptr);
+		std::cerr.rdbuf(nullptr);
+	}
+
+	for (const Scenario& scenario : SCENARIOS)
+	{
+		if (std::strcmp(argv[1], scenario.name) == 0)
+		{
+			Bench::Out() << "[BENCH] : " << scenario.name << " (" << scenario.description << ")" << std::endl;
+			return scenario.run(argc - 1, argv + 1);
+		}
+	}
+
+	Bench::Out() << "[BENCH] : Unknown scenario " << argv[1] << std::endl;
+	return EXIT_FAILURE;
+}
@@ -1,46 +1,107 @@
 #include "ClientSocket.hpp"
 
-#include <ws2tcpip.h>
 #include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
 
 // Need to link with Ws2_32.lib, Mswsock.lib, and Advapi32.lib
 #pragma comment (lib, "Ws2_32.lib")
 #pragma comment (lib, "Mswsock.lib")
 #pragma comment (lib, "AdvApi32.lib")
 
+#define LAST_ERROR() WSAGetLastError()
+#define SEND_FLAGS 0
+
+#else
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define closesocket close
+#define LAST_ERROR() errno
+// A pooled connection closed by the server must not raise SIGPIPE
+#define SEND_FLAGS MSG_NOSIGNAL
+
+#endif
+
 using namespace TCPMachine;
 
-ClientSocket::ClientSocket(std::string host, std::string port) : host(host), port(port)
+ClientSocket::ClientSocket(std::string host, std::string port, bool fastOpen) : host(host), port(port), connSocket(INVALID_SOCKET), bytesReceived(0), fastOpen(fastOpen)
 {
+	InitNetwork();
+
 	if(InitSocket() < 0)
 		throw std::runtime_error("Failed to init socket !");
 }
 
+ClientSocket::ClientSocket(const struct addrinfo* addresses, bool fastOpen) : connSocket(INVALID_SOCKET), bytesReceived(0), fastOpen(fastOpen)
+{
+	InitNetwork();
+
+	if (Connect(addresses) < 0)
+		throw std::runtime_error("Failed to connect socket !");
+}
+
 ClientSocket::~ClientSocket()
 {
 	if (connSocket != INVALID_SOCKET)
 	{
 		closesocket(connSocket);
-		WSACleanup();
 	}
 }
 
+void ClientSocket::InitNetwork()
+{
+#ifdef _WIN32
+	// Started on first use & cleaned up at exit instead of once per socket
+	static struct Winsock {
+		Winsock() { WSADATA wsaData; result = WSAStartup(MAKEWORD(2, 2), &wsaData); }
+		~Winsock() { if (result == 0) WSACleanup(); }
+		int result;
+	} winsock;
+
+	if (winsock.result != 0)
+		throw std::runtime_error("WSAStartup failed with error: " + std::to_string(winsock.result));
+#endif
+}
+
+bool ClientSocket::IsAlive() const
+{
+	if (connSocket == INVALID_SOCKET)
+		return false;
+
+#ifdef _WIN32
+	WSAPOLLFD pfd{};
+	pfd.fd = connSocket;
+	pfd.events = POLLRDNORM;
+	int ready = WSAPoll(&pfd, 1, 0);
+#else
+	struct pollfd pfd {};
+	pfd.fd = connSocket;
+	pfd.events = POLLIN;
+	int ready = poll(&pfd, 1, 0);
+#endif
+
+	// Readable while idle: closed by the server (EOF / RST) or unexpected data, not reusable either way
+	return ready == 0;
+}
+
+uint64_t ClientSocket::GetBytesReceived() const
+{
+	return bytesReceived;
+}
+
 int ClientSocket::InitSocket()
 {
-	WSADATA wsaData;
-	struct addrinfo* result = nullptr, * ptr = nullptr, hints{};
+	struct addrinfo* result = nullptr, hints{};
 	int iResult = -1;
 
-	// Initialize Winsock
-	iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (iResult != 0)
-	{
-		printf("[ERROR] Getaddrinfo failed with error: %d\n", iResult);
-		WSACleanup();
-		return -1;
-	}
-
-	ZeroMemory(&hints, sizeof(hints));
 	// AF_UNSPEC so the returned IP address could be either an IPv6 or IPv4 address for the server.
 	// AF_INET6 for IPv6 or AF_INET for IPv4 in the hints parameter.
 	hints.ai_family = AF_UNSPEC;
@@ -52,22 +113,40 @@ int ClientSocket::InitSocket()
 	if (iResult != 0)
 	{
 		printf("[ERROR] Getaddrinfo failed with error: %d\n", iResult);
-		WSACleanup();
 		return -1;
 	}
 
+	iResult = Connect(result);
+	freeaddrinfo(result);
+
+	return iResult;
+}
+
+int ClientSocket::Connect(const struct addrinfo* addresses)
+{
+	int iResult = -1;
+
 	// Attempt to connect to an address until one succeeds
-	for (ptr = result; ptr != nullptr; ptr = ptr->ai_next)
+	for (const struct addrinfo* ptr = addresses; ptr != nullptr; ptr = ptr->ai_next)
 	{
 		// Create a SOCKET for connecting to server
 		connSocket = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
 		if (connSocket == INVALID_SOCKET)
 		{
-			printf("[ERROR] Socket failed with error: %ld\n", WSAGetLastError());
-			WSACleanup();
+			printf("[ERROR] Socket failed with error: %ld\n", static_cast<long>(LAST_ERROR()));
 			return -1;
 		}
 
+		// Same as the server LowLatency profile: small messages, no Nagle
+		int opt = 1;
+		setsockopt(connSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&opt, sizeof(opt));
+#ifdef TCP_FASTOPEN_CONNECT
+		// Linux 4.11+: connect() returns at once and the SYN leaves with the first send,
+		// carrying its data once the server gave us a fast open cookie (Windows would need ConnectEx)
+		if (fastOpen)
+			setsockopt(connSocket, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, (const char*)&opt, sizeof(opt));
+#endif
+
 		// Connect to server.
 		iResult = connect(connSocket, ptr->ai_addr, (int)ptr->ai_addrlen);
 		if (iResult == SOCKET_ERROR)
@@ -80,12 +159,9 @@ int ClientSocket::InitSocket()
 		break;
 	}
 
-	freeaddrinfo(result);
-
 	if (connSocket == INVALID_SOCKET)
 	{
 		printf("[INFO] Unable to connect to server!\n");
-		WSACleanup();
 		return -1;
 	}
 
@@ -98,7 +174,7 @@ void ClientSocket::SendData(const char* buffer, uint32_t total_bytes)
 
 	while (bytes_sent < total_bytes)
 	{
-		int32_t iResult = static_cast<int32_t>(send(connSocket, buffer + bytes_sent, total_bytes - bytes_sent, 0));
+		int32_t iResult = static_cast<int32_t>(send(connSocket, buffer + bytes_sent, total_bytes - bytes_sent, SEND_FLAGS));
 
 		if (iResult < 0)
 			throw std::runtime_error("Failed to send data");
@@ -122,8 +198,12 @@ void ClientSocket::RecvData(char* buffer, uint32_t total_bytes)
 		if (iResult < 0)
 			throw std::runtime_error("Failed to receive data");
 
+		if (iResult == 0)
+			throw std::runtime_error("Connection closed by server");
+
 		// iResult here is always >= 0 meaning we can add it to an unsigned int
 		bytes_received += iResult;
+		bytesReceived += iResult;
 	}
 
 	if (bytes_received != total_bytes)
@@ -172,7 +252,10 @@ void ClientSocket::SendBoolean(const bool value)
 
 void ClientSocket::RecvBoolean(bool* value)
 {
-	RecvData(reinterpret_cast<char*>(&value), sizeof(bool));
+	// Any byte but 0 is true, a bool holding another value than 0 or 1 is undefined
+	uint8_t byte = 0;
+	RecvData(reinterpret_cast<char*>(&byte), sizeof(byte));
+	*value = byte != 0;
 }
 
 // STD::STRING
@@ -190,9 +273,19 @@ void ClientSocket::RecvString(std::string* str)
 
 	RecvUint32(&buff_len);
 
+	// The stream is out of sync after this, the connection should be dropped
+	if (buff_len > MAX_STRING_SIZE)
+		throw std::runtime_error("String of " + std::to_string(buff_len) + " bytes is over the limit");
+
 	str->clear();
-	str->resize(buff_len); // can throw std::bad_alloc if not enough memory
 
-	// Receive the string
-	RecvData(str->data(), buff_len);
+	// Grown as the payload arrives, a forged length costs the peer as many bytes as us
+	while (str->size() < buff_len)
+	{
+		size_t received = str->size();
+		uint32_t chunk = static_cast<uint32_t>(std::min<size_t>(buff_len - received, std::max<size_t>(received, RECV_CHUNK)));
+
+		str->resize(received + chunk); // can throw std::bad_alloc if not enough memory
+		RecvData(str->data() + received, chunk);
+	}
 }
\ No newline at end of file
@@ -1,9 +1,26 @@
 #pragma once
 
+#ifdef _WIN32
+
 #define WIN32_LEAN_AND_MEAN
 
 #include <windows.h>
 #include <winsock2.h>
+#include <ws2tcpip.h>
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+// Winsock names on POSIX
+using SOCKET = int;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+
+#endif
+
 #include <cstdint>
 #include <string>
 
@@ -13,10 +30,28 @@ namespace TCPMachine {
 
 	public:
 
-		// throw std::runtime error
-		explicit ClientSocket(std::string host, std::string port);
+		// Longest string RecvString accepts, a longer length throws
+		static constexpr uint32_t MAX_STRING_SIZE = 8 * 1024 * 1024;
+
+		// Resolve host & connect, throw std::runtime error
+		// fastOpen: TCP Fast Open (Linux), connect() returns before the handshake so a server that
+		// is down only shows on the first send or recv. Off by default, the CTOR throws instead
+		explicit ClientSocket(std::string host, std::string port, bool fastOpen = false);
+		// Connect to the first address of an already resolved list that answers, throw std::runtime error
+		explicit ClientSocket(const struct addrinfo* addresses, bool fastOpen = false);
 		~ClientSocket();
 
+		ClientSocket(const ClientSocket&) = delete;
+		ClientSocket& operator=(const ClientSocket&) = delete;
+
+		// Winsock is started once per process (no-op on POSIX), called by the CTORs
+		static void InitNetwork();
+
+		// Non blocking check that the server did not close the connection and nothing is pending to read
+		bool IsAlive() const;
+		// Bytes received on this connection so far
+		uint64_t GetBytesReceived() const;
+
 		// Send a buffer, throw std::runtime_error
 		void SendData(const char* buffer, uint32_t total_bytes);
 		// Receive a buffer, throw std::runtime_error
@@ -35,6 +70,7 @@ namespace TCPMachine {
 		// Send a std::string, throw std::runtime_error
 		void SendString(const std::string& str);
 		// Recv a std::string, throw std::runtime_error, std::bad_alloc
+		// Throw without reading the payload if the length is above MAX_STRING_SIZE
 		void RecvString(std::string* str);
 
 		// Send a bool, throw std::runtime_error
@@ -48,9 +84,16 @@ namespace TCPMachine {
 		const std::string port;
 
 		SOCKET connSocket;
+		uint64_t bytesReceived;
+		const bool fastOpen;
+
+		// First read of a string payload, the buffer doubles from there as the bytes arrive
+		static constexpr uint32_t RECV_CHUNK = 64 * 1024;
 		
 		// Called by the CTOR, return 0 if it succeed or -1 if it failed
 		int InitSocket();
+		// Try each address until one connects, return 0 if it succeed or -1 if it failed
+		int Connect(const struct addrinfo* addresses);
 
 		// int ShutDownSending();
 	};
@@ -0,0 +1,225 @@
+#include "ConnectionPool.hpp"
+
+#include <thread>
+#include <stdexcept>
+#include <cstdio>
+#include <algorithm>
+
+using namespace TCPMachine;
+
+// ======================= LEASE: =======================
+
+ConnectionPool::Lease::Lease(ConnectionPool* pool, std::string key, std::unique_ptr<ClientSocket> socket, bool reused) : pool(pool), key(std::move(key)), socket(std::move(socket)), broken(false), reused(reused)
+{
+}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept : pool(other.pool), key(std::move(other.key)), socket(std::move(other.socket)), broken(other.broken), reused(other.reused)
+{
+	other.pool = nullptr;
+}
+
+ConnectionPool::Lease& ConnectionPool::Lease::operator=(Lease&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (pool != nullptr)
+			pool->Release(key, std::move(socket), broken);
+
+		pool = other.pool;
+		key = std::move(other.key);
+		socket = std::move(other.socket);
+		broken = other.broken;
+		reused = other.reused;
+		other.pool = nullptr;
+	}
+
+	return *this;
+}
+
+ConnectionPool::Lease::~Lease()
+{
+	if (pool != nullptr)
+		pool->Release(key, std::move(socket), broken);
+}
+
+ClientSocket* ConnectionPool::Lease::operator->() const
+{
+	return socket.get();
+}
+
+ClientSocket& ConnectionPool::Lease::operator*() const
+{
+	return *socket;
+}
+
+void ConnectionPool::Lease::MarkBroken()
+{
+	broken = true;
+}
+
+bool ConnectionPool::Lease::IsReused() const
+{
+	return reused;
+}
+
+// ======================= POOL: =======================
+
+ConnectionPool::ConnectionPool() : ConnectionPool(Config())
+{
+}
+
+ConnectionPool::ConnectionPool(const Config& config) : config(config), random(std::random_device{}())
+{
+	ClientSocket::InitNetwork();
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	Clear();
+}
+
+ConnectionPool::Lease ConnectionPool::Acquire(const std::string& host, const std::string& port)
+{
+	return Acquire(host, port, true);
+}
+
+ConnectionPool::Lease ConnectionPool::Acquire(const std::string& host, const std::string& port, bool reuse)
+{
+	const std::string key = host + ':' + port;
+
+	{
+		std::unique_lock<std::mutex> lock(guardHosts);
+
+		// Nodes of a std::map are stable, the entry can be kept across unlocks
+		std::unique_ptr<ClientSocket> socket = TakeIdle(hosts[key], lock, reuse);
+
+		if (socket)
+			return Lease(this, key, std::move(socket), true);
+	}
+
+	// ================== Open a new connection ==================
+	// A slot is reserved for us, it is given back by the Lease or below on failure
+	for (uint32_t attempt = 0; attempt < config.maxAttempts; attempt++)
+	{
+		if (attempt > 0)
+			std::this_thread::sleep_for(Backoff(attempt));
+
+		AddrInfo addresses = Resolve(key, host, port);
+
+		if (addresses)
+		{
+			try
+			{
+				return Lease(this, key, std::make_unique<ClientSocket>(addresses.get(), config.fastOpen), false);
+			}
+			catch (const std::exception&)
+			{
+				// The server may have moved, resolve again before the next attempt
+				std::unique_lock<std::mutex> lock(guardHosts);
+				hosts[key].addresses.reset();
+			}
+		}
+	}
+
+	Release(key, nullptr, true);
+	throw std::runtime_error("Unable to connect to " + key + " after " + std::to_string(config.maxAttempts) + " attempts");
+}
+
+void ConnectionPool::Clear()
+{
+	std::unique_lock<std::mutex> lock(guardHosts);
+
+	for (auto& [key, entry] : hosts)
+	{
+		entry.idle.clear();
+		entry.addresses.reset();
+	}
+}
+
+std::unique_ptr<ClientSocket> ConnectionPool::TakeIdle(Host& entry, std::unique_lock<std::mutex>& lock, bool reuse)
+{
+	while (true)
+	{
+		// Most recently used first, it is the least likely to be closed by the server
+		while (reuse && not entry.idle.empty())
+		{
+			Idle idle = std::move(entry.idle.back());
+			entry.idle.pop_back();
+
+			if (Clock::now() - idle.since < config.idleTimeout && idle.socket->IsAlive())
+			{
+				entry.inUse++;
+				return std::move(idle.socket);
+			}
+
+			// Stale, closed by the dtor
+		}
+
+		if (entry.inUse < config.maxPerHost)
+		{
+			entry.inUse++;
+			return nullptr;
+		}
+
+		released.wait(lock);
+	}
+}
+
+ConnectionPool::AddrInfo ConnectionPool::Resolve(const std::string& key, const std::string& host, const std::string& port)
+{
+	{
+		std::unique_lock<std::mutex> lock(guardHosts);
+		Host& entry = hosts[key];
+
+		if (entry.addresses && Clock::now() - entry.resolvedAt < config.dnsTtl)
+			return entry.addresses;
+	}
+
+	// Resolved without the lock, it can take a while
+	struct addrinfo* result = nullptr, hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	int iResult = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+	if (iResult != 0)
+	{
+		printf("[ERROR] Getaddrinfo failed with error: %d\n", iResult);
+		return nullptr;
+	}
+
+	AddrInfo addresses(result, freeaddrinfo);
+
+	std::unique_lock<std::mutex> lock(guardHosts);
+	Host& entry = hosts[key];
+	entry.addresses = addresses;
+	entry.resolvedAt = Clock::now();
+
+	return addresses;
+}
+
+std::chrono::milliseconds ConnectionPool::Backoff(uint32_t attempt)
+{
+	// Full jitter so reconnecting clients do not all come back at the same time
+	int64_t ceiling = config.baseBackoff.count() << std::min<uint32_t>(attempt, 20);
+	ceiling = std::min<int64_t>(ceiling, config.maxBackoff.count());
+
+	std::unique_lock<std::mutex> lock(guardHosts);
+	std::uniform_int_distribution<int64_t> distribution(0, ceiling);
+
+	return std::chrono::milliseconds(distribution(random));
+}
+
+void ConnectionPool::Release(const std::string& key, std::unique_ptr<ClientSocket> socket, bool broken)
+{
+	{
+		std::unique_lock<std::mutex> lock(guardHosts);
+		Host& entry = hosts[key];
+		entry.inUse--;
+
+		if (socket && not broken)
+			entry.idle.push_back({ std::move(socket), Clock::now() });
+	}
+
+	released.notify_one();
+}
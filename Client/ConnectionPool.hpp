@@ -0,0 +1,162 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+
+#include "ClientSocket.hpp"
+
+namespace TCPMachine {
+
+	// Reuse connections to the server instead of paying DNS + TCP handshake per request.
+	// Addresses are cached per host:port, idle connections are checked before reuse and
+	// failed connects are retried with a jittered exponential backoff.
+	class ConnectionPool {
+
+	public:
+
+		struct Config {
+			// Connections per host:port, in use + idle. Acquire waits when reached
+			size_t maxPerHost = 8;
+			// Idle connections older than this are closed instead of reused
+			std::chrono::milliseconds idleTimeout{ 30000 };
+			// Addresses are resolved again after this
+			std::chrono::milliseconds dnsTtl{ 60000 };
+			// Connect attempts before Acquire throws
+			uint32_t maxAttempts = 5;
+			// Backoff before attempt n is random in [0, min(maxBackoff, baseBackoff * 2^n)]
+			std::chrono::milliseconds baseBackoff{ 50 };
+			std::chrono::milliseconds maxBackoff{ 5000 };
+			// TCP Fast Open on the new connections. A server that is down is then only seen by the
+			// first request instead of Acquire, which does not back off nor retry in that case
+			bool fastOpen = false;
+		};
+
+		class Lease;
+
+		// Must outlive the leases it gave
+		ConnectionPool();
+		explicit ConnectionPool(const Config& config);
+		~ConnectionPool();
+
+		ConnectionPool(const ConnectionPool&) = delete;
+		ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+		// An idle healthy connection or a new one, throw std::runtime_error once all attempts failed
+		Lease Acquire(const std::string& host, const std::string& port);
+
+		// Run fn(ClientSocket&) on a pooled connection & return what it returns.
+		// The server can close an idle connection right after its health check: when fn throws on
+		// a reused connection before anything was received, fn runs once more on a new connection.
+		// fn must be safe to send again in that case. Throw what fn threw otherwise
+		template <typename Fn>
+		auto Run(const std::string& host, const std::string& port, Fn fn)
+		{
+			{
+				Lease lease = Acquire(host, port);
+				const uint64_t received = lease->GetBytesReceived();
+
+				try
+				{
+					return fn(*lease);
+				}
+				catch (const std::exception&)
+				{
+					lease.MarkBroken();
+
+					if (not lease.IsReused() || lease->GetBytesReceived() != received)
+						throw;
+				}
+			}
+
+			// The broken one gave its slot back above, a pool of 1 does not wait on itself
+			Lease lease = Acquire(host, port, false);
+
+			try
+			{
+				return fn(*lease);
+			}
+			catch (const std::exception&)
+			{
+				lease.MarkBroken();
+				throw;
+			}
+		}
+
+		// Close the idle connections & forget the cached addresses
+		void Clear();
+
+		// Connection borrowed from the pool, given back when destroyed
+		class Lease {
+
+		public:
+
+			Lease(Lease&& other) noexcept;
+			Lease& operator=(Lease&& other) noexcept;
+			~Lease();
+
+			ClientSocket* operator->() const;
+			ClientSocket& operator*() const;
+
+			// The connection failed (e.g. a Send/Recv threw): close it instead of reusing it
+			void MarkBroken();
+			// True if it was taken idle from the pool, false if it was connected for this lease
+			bool IsReused() const;
+
+		private:
+
+			friend class ConnectionPool;
+
+			Lease(ConnectionPool* pool, std::string key, std::unique_ptr<ClientSocket> socket, bool reused);
+
+			ConnectionPool* pool;
+			std::string key;
+			std::unique_ptr<ClientSocket> socket;
+			bool broken;
+			bool reused;
+		};
+
+	private:
+
+		using Clock = std::chrono::steady_clock;
+		using AddrInfo = std::shared_ptr<struct addrinfo>;
+
+		struct Idle {
+			std::unique_ptr<ClientSocket> socket;
+			Clock::time_point since;
+		};
+
+		struct Host {
+			AddrInfo addresses;
+			Clock::time_point resolvedAt;
+			// Most recently used last
+			std::vector<Idle> idle;
+			size_t inUse = 0;
+		};
+
+		const Config config;
+
+		std::mutex guardHosts;
+		// Signaled when a connection is given back
+		std::condition_variable released;
+		// key: "host:port"
+		std::map<std::string, Host> hosts;
+
+		std::mt19937 random;
+
+		// reuse: false to always open a new connection
+		Lease Acquire(const std::string& host, const std::string& port, bool reuse);
+		// Take an idle healthy connection (if reuse) or a free slot, wait if the host is full. guardHosts held
+		std::unique_ptr<ClientSocket> TakeIdle(Host& entry, std::unique_lock<std::mutex>& lock, bool reuse);
+		// Cached addresses or resolve them again once expired, nullptr if it failed
+		AddrInfo Resolve(const std::string& key, const std::string& host, const std::string& port);
+		// Jittered delay before attempt n
+		std::chrono::milliseconds Backoff(uint32_t attempt);
+		// Called by the Lease
+		void Release(const std::string& key, std::unique_ptr<ClientSocket> socket, bool broken);
+	};
+}
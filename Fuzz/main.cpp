@@ -0,0 +1,208 @@
+// Fuzz: the decoders of Session (RecvString, RecvUint32, RecvInt32, RecvBoolean) fed through a socketpair
+// libFuzzer: clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address -DLIBFUZZER Fuzz/main.cpp Server/*.cpp (without Server/main.cpp)
+//   then Fuzz corpus/ (mutates the seeds of Fuzz/corpus, copy them first)
+// Without libFuzzer: Fuzz <file|directory>... runs every input once (regressions & the seeds under ASan/UBSan)
+//
+// Input: the first byte picks the decoders, the rest is what the client sends
+//   bits 2i & 2i+1 pick the decoder of the read i (mod 4): 0 RecvString, 1 RecvUint32, 2 RecvInt32, 3 RecvBoolean
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "../Server/Session.hpp"
+
+using namespace TCPMachine;
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+namespace {
+
+	// Send the bytes of the client then end its side, a session shut down early stops it
+	void Feed(int fd, const uint8_t* data, size_t size)
+	{
+		size_t sent = 0;
+
+		while (sent < size)
+		{
+			const ssize_t result = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+
+			if (result <= 0)
+				break;
+
+			sent += static_cast<size_t>(result);
+		}
+
+		shutdown(fd, SHUT_WR);
+	}
+
+	// Decode until the stream ends or is refused, return the nb of values read
+	size_t Decode(Session& session, uint8_t decoders)
+	{
+		std::string str;
+		uint32_t uinteger;
+		int32_t integer;
+		bool value;
+		size_t nbOfReads = 0;
+
+		while (true)
+		{
+			try
+			{
+				switch ((decoders >> (2 * (nbOfReads % 4))) & 3)
+				{
+				case 0:
+					session.RecvString(&str);
+					// A string is never bigger than announced nor than the limit
+					if (str.size() > Session::MAX_STRING_SIZE)
+						std::abort();
+					break;
+				case 1:
+					session.RecvUint32(&uinteger);
+					break;
+				case 2:
+					session.RecvInt32(&integer);
+					break;
+				default:
+					session.RecvBoolean(&value);
+					break;
+				}
+			}
+			catch (const Session::Rejected&)
+			{
+				// Payload skipped, the session keeps going
+			}
+			catch (const std::runtime_error&)
+			{
+				// Closed, truncated or over the limit
+				return nbOfReads;
+			}
+
+			nbOfReads++;
+		}
+	}
+
+	// Run the input in path, every file of path if it is a directory
+	// Return the nb of inputs run or -1
+	int Run(const std::string& path)
+	{
+		struct stat info;
+
+		if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+		{
+			DIR* directory = opendir(path.c_str());
+
+			if (directory == nullptr)
+				return -1;
+
+			int nbOfInputs = 0;
+
+			for (struct dirent* entry = readdir(directory); entry != nullptr; entry = readdir(directory))
+			{
+				if (entry->d_name[0] == '.')
+					continue;
+
+				const int result = Run(path + "/" + entry->d_name);
+
+				if (result < 0)
+				{
+					closedir(directory);
+					return -1;
+				}
+
+				nbOfInputs += result;
+			}
+
+			closedir(directory);
+			return nbOfInputs;
+		}
+
+		std::ifstream file(path, std::ios::binary);
+
+		if (not file)
+		{
+			std::cerr << "[FUZZ] : Cannot read " << path << std::endl;
+			return -1;
+		}
+
+		const std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		LLVMFuzzerTestOneInput(input.data(), input.size());
+		return 1;
+	}
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+	(void)argc;
+	(void)argv;
+
+	// Every session prints its destruction
+	std::cout.rdbuf(nullptr);
+	return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+	int fds[2];
+
+	// Failing here means the previous inputs leaked their sockets
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+		std::abort();
+
+	// A new limiter per input so every run is the same: the 5th message on is rejected and skipped
+	RateLimiter::Config config;
+	config.messages = { 1, 4, RateLimiter::Action::Reject };
+	RateLimiter limiter(config);
+
+	std::thread client(Feed, fds[1], data + 1, size - 1);
+
+	{
+		Session session(fds[0], Endpoint{}, 0, &limiter, nullptr, Session::Batching());
+		Decode(session, data[0]);
+		// The destructor closes the socket, a client blocked on a full buffer gets EPIPE
+	}
+
+	client.join();
+	close(fds[1]);
+	return 0;
+}
+
+#ifndef LIBFUZZER
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " <file|directory>..." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	LLVMFuzzerInitialize(&argc, &argv);
+	int nbOfInputs = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const int result = Run(argv[i]);
+
+		if (result < 0)
+			return EXIT_FAILURE;
+
+		nbOfInputs += result;
+	}
+
+	std::cerr << "[FUZZ] : " << nbOfInputs << " inputs decoded" << std::endl;
+	return EXIT_SUCCESS;
+}
+#endif
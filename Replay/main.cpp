@@ -0,0 +1,342 @@
+// Replay: re-drive a server from a capture recorded with Server --capture <path>
+// Usage: Replay <capture file> <host> <port> [speed]
+//   speed: 1 (default) for real time, N for N times faster, max for no waits
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "../Server/CaptureFormat.hpp"
+
+using namespace TCPMachine;
+using Clock = std::chrono::steady_clock;
+
+// Threads of the replay: sessions replayed at the same time at most, the next ones wait for a thread
+#define MAX_CONCURRENT_SESSIONS 4096
+// Time given to the server to end a session after it did in the capture
+#define CLOSE_GRACE_MS 1000
+
+namespace {
+
+	struct Frame {
+		uint64_t timestamp;
+		const char* data;
+		uint32_t length;
+	};
+
+	struct RecordedSession {
+		uint64_t opened = 0;
+		uint64_t closed = 0;
+		std::vector<Frame> frames;
+	};
+
+	struct Stats {
+		std::atomic<uint64_t> frames{ 0 };
+		std::atomic<uint64_t> bytes{ 0 };
+		std::atomic<uint64_t> failed{ 0 };
+
+		std::mutex guardDurations;
+		// Time from connect to the end of the session, in us
+		std::vector<int64_t> durations;
+	};
+
+	// Scaled time of a record, speed 0 means as fast as possible
+	Clock::time_point Due(Clock::time_point start, uint64_t timestamp, double speed)
+	{
+		if (speed <= 0)
+			return start;
+
+		return start + std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(timestamp) / speed));
+	}
+
+	// Drop what the server sent so it never blocks on a full socket
+	void Drain(int fd)
+	{
+		char buffer[16 * 1024];
+		while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+	}
+
+	bool SendAll(int fd, const char* data, uint32_t length)
+	{
+		uint32_t sent = 0;
+
+		while (sent < length)
+		{
+			ssize_t iResult = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+
+			if (iResult <= 0)
+				return false;
+
+			sent += static_cast<uint32_t>(iResult);
+		}
+
+		return true;
+	}
+
+	void ReplaySession(const RecordedSession& recorded, const struct addrinfo* address, Clock::time_point start, double speed, Stats* stats)
+	{
+		std::this_thread::sleep_until(Due(start, recorded.opened, speed));
+
+		int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		const Clock::time_point connected = Clock::now();
+
+		if (fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+		{
+			stats->failed++;
+			if (fd >= 0)
+				close(fd);
+			return;
+		}
+
+		int opt = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+		for (const Frame& frame : recorded.frames)
+		{
+			std::this_thread::sleep_until(Due(start, frame.timestamp, speed));
+			Drain(fd);
+
+			if (not SendAll(fd, frame.data, frame.length))
+			{
+				stats->failed++;
+				close(fd);
+				return;
+			}
+
+			stats->frames++;
+			stats->bytes += frame.length;
+		}
+
+		// Wait for the server to end the session, at most until it did in the capture (+ grace)
+		const Clock::time_point deadline = std::max(Due(start, recorded.closed, speed), Clock::now()) + std::chrono::milliseconds(CLOSE_GRACE_MS);
+		char buffer[16 * 1024];
+
+		while (Clock::now() < deadline)
+		{
+			struct pollfd pfd { fd, POLLIN, 0 };
+			int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count());
+
+			if (poll(&pfd, 1, std::max(timeout, 0)) <= 0 || recv(fd, buffer, sizeof(buffer), 0) <= 0)
+				break;
+		}
+
+		close(fd);
+
+		std::unique_lock<std::mutex> lock(stats->guardDurations);
+		stats->durations.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - connected).count());
+	}
+
+	// cut: nb of sessions still open when a full log stopped the capture, they end there
+	// Return 0 if it succeed or -1 if it failed
+	int Load(const char* map, size_t size, std::map<uint64_t, RecordedSession>* sessions, size_t* cut)
+	{
+		CaptureFormat::FileHeader header;
+
+		if (size < sizeof(header))
+			return -1;
+
+		std::memcpy(&header, map, sizeof(header));
+
+		if (std::memcmp(header.magic, CaptureFormat::MAGIC, sizeof(header.magic)) != 0)
+			return -1;
+
+		// length is 0 if the server did not close the capture, read what is there
+		size_t end = sizeof(header) + (header.length > 0 ? header.length : size - sizeof(header));
+		end = std::min(end, size);
+
+		size_t offset = sizeof(header);
+		bool truncated = false;
+		uint64_t truncatedAt = 0;
+
+		while (not truncated && offset + sizeof(CaptureFormat::RecordHeader) <= end)
+		{
+			CaptureFormat::RecordHeader record;
+			std::memcpy(&record, map + offset, sizeof(record));
+			offset += sizeof(record);
+
+			// Unwritten tail of a capture that was not closed
+			if (record.sessionId == 0 || offset + record.length > end)
+				break;
+
+			// The last record, not a session of its own
+			if (record.type == CaptureFormat::RecordType::Truncated)
+			{
+				truncated = true;
+				truncatedAt = record.timestamp;
+				break;
+			}
+
+			RecordedSession& session = (*sessions)[record.sessionId];
+
+			switch (record.type)
+			{
+			case CaptureFormat::RecordType::Open:
+				session.opened = record.timestamp;
+				break;
+			case CaptureFormat::RecordType::Data:
+				session.frames.push_back({ record.timestamp, map + offset, record.length });
+				break;
+			case CaptureFormat::RecordType::Close:
+				session.closed = record.timestamp;
+				break;
+			default:
+				break;
+			}
+
+			offset += record.length;
+		}
+
+		*cut = 0;
+
+		// Without their Close the sessions would wait for the server until the grace
+		for (auto& [id, session] : *sessions)
+		{
+			if (truncated && session.closed == 0)
+			{
+				session.closed = std::max(truncatedAt, session.opened);
+				(*cut)++;
+			}
+		}
+
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cerr << "Usage: " << argv[0] << " <capture file> <host> <port> [speed|max]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// 0 is max, anything else must be a positive number
+	double speed = 1;
+	if (argc > 4 && std::strcmp(argv[4], "max") == 0)
+		speed = 0;
+	else if (argc > 4)
+	{
+		char* end = nullptr;
+		speed = std::strtod(argv[4], &end);
+
+		if (end == argv[4] || *end != '\0' || not (speed > 0) || std::isinf(speed))
+		{
+			std::cerr << "[REPLAY] : Invalid speed " << argv[4] << ", expected a positive number or max" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// ================== Map the capture ==================
+	int fd = open(argv[1], O_RDONLY);
+	struct stat st {};
+
+	if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		std::cerr << "[REPLAY] : Could not open " << argv[1] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	size_t size = static_cast<size_t>(st.st_size);
+	void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		std::cerr << "[REPLAY] : Could not map " << argv[1] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::map<uint64_t, RecordedSession> sessions;
+	size_t cut = 0;
+
+	if (Load(static_cast<const char*>(map), size, &sessions, &cut) < 0)
+	{
+		std::cerr << "[REPLAY] : " << argv[1] << " is not a capture file" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (cut > 0)
+		std::cout << "[REPLAY] : The log was full, " << cut << " sessions are replayed up to where the capture stopped" << std::endl;
+
+	// Started in the order they were accepted
+	std::vector<const RecordedSession*> ordered;
+	for (const auto& [id, session] : sessions)
+		ordered.push_back(&session);
+
+	std::sort(ordered.begin(), ordered.end(), [](const RecordedSession* a, const RecordedSession* b) { return a->opened < b->opened; });
+
+	// ================== Resolve the server ==================
+	struct addrinfo* address = nullptr, hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	if (getaddrinfo(argv[2], argv[3], &hints, &address) != 0)
+	{
+		std::cerr << "[REPLAY] : Could not resolve " << argv[2] << ":" << argv[3] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "[REPLAY] : " << ordered.size() << " sessions at " << (speed > 0 ? std::to_string(speed) + "x" : std::string("max speed")) << std::endl;
+
+	// ================== Replay with the original concurrency ==================
+	// A fixed pool: each thread takes the next session to start once its previous one is over
+	Stats stats;
+	std::atomic_size_t next{ 0 };
+	std::vector<std::thread> threads;
+
+	const Clock::time_point start = Clock::now();
+
+	for (size_t i = 0; i < std::min<size_t>(ordered.size(), MAX_CONCURRENT_SESSIONS); i++)
+	{
+		threads.emplace_back([&]() {
+			for (size_t index = next++; index < ordered.size(); index = next++)
+				ReplaySession(*ordered[index], address, start, speed, &stats);
+		});
+	}
+
+	for (auto& th : threads)
+		th.join();
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	freeaddrinfo(address);
+	munmap(map, size);
+
+	// ================== Report ==================
+	std::sort(stats.durations.begin(), stats.durations.end());
+
+	auto percentile = [&stats](double p) -> int64_t {
+		if (stats.durations.empty())
+			return 0;
+		return stats.durations[static_cast<size_t>(p * static_cast<double>(stats.durations.size() - 1))];
+	};
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "[REPLAY] : Sessions: " << ordered.size() << " (failed: " << stats.failed.load() << ")" << std::endl;
+	std::cout << "[REPLAY] : Frames: " << stats.frames.load() << ", Bytes: " << stats.bytes.load() << " in " << seconds << " s" << std::endl;
+	std::cout << "[REPLAY] : Throughput: " << static_cast<double>(stats.frames.load()) / seconds << " frames/s, "
+		<< static_cast<double>(stats.bytes.load()) / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+	std::cout << "[REPLAY] : Session duration p50: " << percentile(0.50) << " us, p99: " << percentile(0.99)
+		<< " us, max: " << percentile(1.0) << " us" << std::endl;
+
+	return EXIT_SUCCESS;
+}
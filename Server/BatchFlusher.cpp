@@ -0,0 +1,106 @@
+#include "BatchFlusher.hpp"
+
+#include <chrono>
+#include <sys/prctl.h>
+
+using namespace TCPMachine;
+
+namespace {
+
+	// steady_clock ns
+	int64_t NowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+BatchFlusher::BatchFlusher(SessionRegistry* registry) : registry(registry), running(false)
+{
+}
+
+BatchFlusher::~BatchFlusher()
+{
+	Stop();
+}
+
+int BatchFlusher::Start()
+{
+	std::unique_lock<std::mutex> lock(guard);
+
+	if (running)
+		return -1;
+
+	running = true;
+	thread = std::thread(&BatchFlusher::Run, this);
+	return 0;
+}
+
+void BatchFlusher::Stop()
+{
+	{
+		std::unique_lock<std::mutex> lock(guard);
+		running = false;
+		wake.notify_one();
+	}
+
+	if (thread.joinable())
+		thread.join();
+
+	deadlines = {};
+}
+
+void BatchFlusher::Schedule(uint64_t id, int64_t deadline)
+{
+	std::unique_lock<std::mutex> lock(guard);
+
+	if (not running)
+		return;
+
+	// Budgets are all the same, the new deadline is rarely the earliest
+	const bool earliest = deadlines.empty() || deadline < deadlines.top().first;
+	deadlines.emplace(deadline, id);
+
+	if (earliest)
+		wake.notify_one();
+}
+
+void BatchFlusher::Run()
+{
+	// The default 50 us slack of the timers would add up to 50 us to every budget
+	prctl(PR_SET_TIMERSLACK, 1);
+
+	std::vector<uint64_t> due;
+	std::unique_lock<std::mutex> lock(guard);
+
+	while (running)
+	{
+		if (deadlines.empty())
+		{
+			wake.wait(lock);
+			continue;
+		}
+
+		const int64_t now = NowNs();
+
+		if (deadlines.top().first > now)
+		{
+			wake.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadlines.top().first)));
+			continue;
+		}
+
+		while (not deadlines.empty() && deadlines.top().first <= now)
+		{
+			due.push_back(deadlines.top().second);
+			deadlines.pop();
+		}
+
+		// The sessions may schedule again while they are flushed
+		lock.unlock();
+
+		for (uint64_t id : due)
+			registry->FlushExpired(id, now);
+
+		due.clear();
+		lock.lock();
+	}
+}
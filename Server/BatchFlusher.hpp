@@ -0,0 +1,53 @@
+#pragma once
+
+#include <mutex>
+#include <queue>
+#include <vector>
+#include <thread>
+#include <utility>
+#include <cstdint>
+#include <condition_variable>
+
+#include "SessionRegistry.hpp"
+
+namespace TCPMachine {
+
+	// Sends the batches of the sessions once their budget expired.
+	// A session schedules its id when its batch starts, the thread sleeps on a condition
+	// variable until the earliest deadline of a min-heap and only visits the sessions due.
+	// A batch sent meanwhile (full, Flush or recv) leaves a stale entry that does nothing,
+	// a socket full when due is left to the worker: its next recv or Flush sends the rest.
+	class BatchFlusher {
+
+	public:
+
+		// registry: the scheduled ids are looked up there, a session gone meanwhile is skipped
+		explicit BatchFlusher(SessionRegistry* registry);
+		~BatchFlusher();
+
+		// Start the thread, return -1 if it already runs
+		int Start();
+		// Join the thread, the deadlines left are dropped
+		void Stop();
+
+		// The batch of the session id must be sent at deadline (steady_clock ns), safe from any thread
+		// Ignored while the thread is not running
+		void Schedule(uint64_t id, int64_t deadline);
+
+	private:
+
+		SessionRegistry* registry;
+
+		// Protect deadlines & running
+		std::mutex guard;
+		// Wake up the thread when an earlier deadline is scheduled or on Stop
+		std::condition_variable wake;
+		// Session ids by the steady_clock ns they are due, earliest on top
+		std::priority_queue<std::pair<int64_t, uint64_t>, std::vector<std::pair<int64_t, uint64_t>>, std::greater<std::pair<int64_t, uint64_t>>> deadlines;
+		bool running;
+		std::thread thread;
+
+		// Pop the due ids & flush them until Stop
+		void Run();
+	};
+}
@@ -0,0 +1,150 @@
+#include "Broadcaster.hpp"
+
+#include <cstring>
+#include <thread>
+#include <arpa/inet.h>
+
+using namespace TCPMachine;
+
+Broadcaster::Broadcaster(size_t maxQueued, Session::OverflowPolicy policy) : maxQueued(maxQueued), policy(policy)
+{
+}
+
+void Broadcaster::Subscribe(const std::string& topic, Session* session)
+{
+	std::unique_lock<std::shared_mutex> lock(guardTopics);
+
+	std::unique_ptr<Subscriber>& subscriber = subscribers[session];
+
+	if (subscriber == nullptr)
+	{
+		subscriber = std::make_unique<Subscriber>();
+		subscriber->session = session;
+	}
+
+	std::vector<Subscriber*>& list = topics[topic];
+
+	if (subscriber->topics.emplace(topic, list.size()).second)
+		list.push_back(subscriber.get());
+}
+
+void Broadcaster::Unsubscribe(const std::string& topic, Session* session)
+{
+	std::unique_ptr<Subscriber> removed;
+
+	{
+		std::unique_lock<std::shared_mutex> lock(guardTopics);
+
+		auto subscriber = subscribers.find(session);
+
+		if (subscriber == subscribers.end())
+			return;
+
+		auto it = subscriber->second->topics.find(topic);
+
+		if (it == subscriber->second->topics.end())
+			return;
+
+		Remove(topic, it->second);
+		subscriber->second->topics.erase(it);
+
+		// Last topic, a publisher may still hold it
+		if (subscriber->second->topics.empty())
+		{
+			removed = std::move(subscriber->second);
+			subscribers.erase(subscriber);
+		}
+	}
+
+	while (removed != nullptr && removed->pins.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+}
+
+void Broadcaster::UnsubscribeAll(Session* session)
+{
+	std::unique_ptr<Subscriber> removed;
+
+	{
+		std::unique_lock<std::shared_mutex> lock(guardTopics);
+
+		auto subscriber = subscribers.find(session);
+
+		if (subscriber == subscribers.end())
+			return;
+
+		removed = std::move(subscriber->second);
+		subscribers.erase(subscriber);
+
+		for (const auto& topic : removed->topics)
+			Remove(topic.first, topic.second);
+	}
+
+	// No publisher can pin it anymore, wait for the ones that did (they only queue, never block)
+	while (removed->pins.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+}
+
+void Broadcaster::Remove(const std::string& topic, size_t index)
+{
+	auto it = topics.find(topic);
+	std::vector<Subscriber*>& list = it->second;
+
+	// The last one takes the slot
+	list[index] = list.back();
+	list[index]->topics[topic] = index;
+	list.pop_back();
+
+	if (list.empty())
+		topics.erase(it);
+}
+
+size_t Broadcaster::Publish(const std::string& topic, const std::string& payload)
+{
+	// Serialized once, the subscribers only hold a reference
+	SharedFrame frame = Frame(payload);
+	std::vector<Subscriber*> pinned;
+
+	// ================== Copy & pin the subscribers ==================
+	{
+		std::shared_lock<std::shared_mutex> lock(guardTopics);
+
+		auto it = topics.find(topic);
+
+		if (it == topics.end())
+			return 0;
+
+		pinned.reserve(it->second.size());
+
+		for (Subscriber* subscriber : it->second)
+		{
+			subscriber->pins.fetch_add(1, std::memory_order_relaxed);
+			pinned.push_back(subscriber);
+		}
+	}
+
+	// ================== Queue without the lock ==================
+	size_t reached = 0;
+
+	for (Subscriber* subscriber : pinned)
+	{
+		if (subscriber->session->Enqueue(frame, maxQueued, policy))
+			reached++;
+
+		subscriber->pins.fetch_sub(1, std::memory_order_release);
+	}
+
+	return reached;
+}
+
+SharedFrame Broadcaster::Frame(const std::string& payload)
+{
+	// Convert from Host Byte Order to Network Byte Order
+	uint32_t netUint = htonl(static_cast<uint32_t>(payload.size()));
+
+	std::string frame;
+	frame.reserve(sizeof(uint32_t) + payload.size());
+	frame.append(reinterpret_cast<const char*>(&netUint), sizeof(uint32_t));
+	frame.append(payload);
+
+	return std::make_shared<const std::string>(std::move(frame));
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "Session.hpp"
+
+namespace TCPMachine {
+
+	// Topic based broadcast: a message is framed once into an immutable shared buffer
+	// and queued by reference on the outbound queue of every subscriber.
+	// Publish only holds the topics lock to copy the subscribers, the sends happen after it
+	// so a (un)subscribe never waits for a fan-out.
+	class Broadcaster {
+
+	public:
+
+		// Every session is subscribed to it while it runs
+		static constexpr const char* ALL = "all";
+
+		// maxQueued: frames a slow subscriber may have waiting before the policy applies
+		explicit Broadcaster(size_t maxQueued = 64, Session::OverflowPolicy policy = Session::OverflowPolicy::CoalesceLatest);
+
+		void Subscribe(const std::string& topic, Session* session);
+		void Unsubscribe(const std::string& topic, Session* session);
+		// Must be called before the session is destroyed, waits for the publishers still sending to it
+		void UnsubscribeAll(Session* session);
+
+		// Frame the payload once & queue it on every subscriber of the topic
+		// Return the nb of subscribers it was queued to
+		size_t Publish(const std::string& topic, const std::string& payload);
+
+		// Same framing as Session::SendString: uint32 length (network order) + payload
+		static SharedFrame Frame(const std::string& payload);
+
+	private:
+
+		struct Subscriber {
+			Session* session;
+			// Publishers sending to the session outside of the lock, UnsubscribeAll waits for 0
+			std::atomic<uint32_t> pins{ 0 };
+			// Topics of the session & its index in each of them, (un)subscribe in O(1)
+			std::unordered_map<std::string, size_t> topics;
+		};
+
+		const size_t maxQueued;
+		const Session::OverflowPolicy policy;
+
+		// Shared by the publishers while they copy & pin the subscribers, exclusive to (un)subscribe
+		std::shared_mutex guardTopics;
+		// A vector per topic so a publisher copies it in one go, removed by swapping with the last one
+		std::unordered_map<std::string, std::vector<Subscriber*>> topics;
+		std::unordered_map<Session*, std::unique_ptr<Subscriber>> subscribers;
+
+		// Remove the subscriber from the topic, guardTopics held exclusively
+		void Remove(const std::string& topic, size_t index);
+	};
+}
@@ -0,0 +1,236 @@
+#include "Capture.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+using namespace TCPMachine;
+
+// ======================= LOG: =======================
+
+CaptureLog::CaptureLog() : fd(-1), map(nullptr), capacity(0), offset(0), nextSessionId(1), nbOfRecords(0), nbOfDropped(0), overheadNs(0)
+{
+}
+
+CaptureLog::~CaptureLog()
+{
+	if (IsOpen())
+		Close();
+}
+
+int CaptureLog::Open(const std::string& path, size_t maxBytes)
+{
+	if (IsOpen())
+	{
+		std::cerr << "[CAPTURE] : Capture already open" << std::endl;
+		return -1;
+	}
+
+	// The Truncated record must always fit
+	if (maxBytes < sizeof(CaptureFormat::RecordHeader))
+	{
+		std::cerr << "[CAPTURE] : " << maxBytes << " bytes cannot hold a record" << std::endl;
+		return -1;
+	}
+
+	if ((fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+	{
+		std::cerr << "[CAPTURE] : Could not open " << path << std::endl;
+		return -1;
+	}
+
+	// Sparse file, the pages are only allocated once written
+	size_t size = sizeof(CaptureFormat::FileHeader) + maxBytes;
+
+	if (ftruncate(fd, static_cast<off_t>(size)) < 0)
+	{
+		std::cerr << "[CAPTURE] : Could not size " << path << std::endl;
+		close(fd);
+		fd = -1;
+		return -1;
+	}
+
+	void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (addr == MAP_FAILED)
+	{
+		std::cerr << "[CAPTURE] : Could not map " << path << std::endl;
+		close(fd);
+		fd = -1;
+		return -1;
+	}
+
+	map = static_cast<char*>(addr);
+	capacity = maxBytes;
+	offset.store(0);
+	start = std::chrono::steady_clock::now();
+
+	CaptureFormat::FileHeader header{};
+	std::memcpy(header.magic, CaptureFormat::MAGIC, sizeof(header.magic));
+	header.startedAt = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+	header.length = 0;
+	std::memcpy(map, &header, sizeof(header));
+
+	std::cout << "[CAPTURE] : Recording sessions to " << path << std::endl;
+	return 0;
+}
+
+void CaptureLog::Close()
+{
+	if (not IsOpen())
+		return;
+
+	size_t used = offset.load() & ~STOPPED;
+
+	// Length written last, a reader of a crashed capture sees 0 and scans the records
+	reinterpret_cast<CaptureFormat::FileHeader*>(map)->length = used;
+
+	munmap(map, sizeof(CaptureFormat::FileHeader) + capacity);
+	if (ftruncate(fd, static_cast<off_t>(sizeof(CaptureFormat::FileHeader) + used)) < 0)
+		std::cerr << "[CAPTURE] : Could not trim the capture file" << std::endl;
+	close(fd);
+
+	map = nullptr;
+	fd = -1;
+
+	std::cout << "[CAPTURE] : " << nbOfRecords.load() << " records, " << used << " bytes, "
+		<< nbOfDropped.load() << " dropped, overhead " << overheadNs.load() / 1000 << " us" << std::endl;
+}
+
+bool CaptureLog::IsOpen() const
+{
+	return map != nullptr;
+}
+
+bool CaptureLog::IsRecording() const
+{
+	return IsOpen() && (offset.load(std::memory_order_relaxed) & STOPPED) == 0;
+}
+
+uint64_t CaptureLog::NextSessionId()
+{
+	return nextSessionId.fetch_add(1);
+}
+
+uint64_t CaptureLog::Now() const
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+uint64_t CaptureLog::Since(int64_t steadyNs) const
+{
+	const int64_t opened = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+	return steadyNs > opened ? static_cast<uint64_t>(steadyNs - opened) : 0;
+}
+
+bool CaptureLog::Append(uint64_t sessionId, const char* records, size_t size)
+{
+	// Reserve without leaving a hole, the room of the Truncated record is never given to a batch
+	const size_t limit = capacity - sizeof(CaptureFormat::RecordHeader);
+	size_t at = offset.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		if (at & STOPPED)
+		{
+			nbOfDropped++;
+			return false;
+		}
+
+		if (at + size <= limit)
+		{
+			if (offset.compare_exchange_weak(at, at + size, std::memory_order_relaxed))
+				break;
+
+			continue;
+		}
+
+		// Stop: the winner writes the last record, the batches still copying end before it
+		if (offset.compare_exchange_weak(at, (at + sizeof(CaptureFormat::RecordHeader)) | STOPPED, std::memory_order_relaxed))
+		{
+			CaptureFormat::RecordHeader header{};
+			header.timestamp = Now();
+			header.sessionId = sessionId;
+			header.type = CaptureFormat::RecordType::Truncated;
+			std::memcpy(map + sizeof(CaptureFormat::FileHeader) + at, &header, sizeof(header));
+
+			nbOfDropped++;
+			std::cerr << "[CAPTURE] : Log full after " << at << " bytes, capture stopped" << std::endl;
+			return false;
+		}
+	}
+
+	std::memcpy(map + sizeof(CaptureFormat::FileHeader) + at, records, size);
+	return true;
+}
+
+void CaptureLog::AddOverhead(uint64_t ns)
+{
+	overheadNs.fetch_add(ns, std::memory_order_relaxed);
+	nbOfRecords.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ======================= BUFFER: =======================
+
+CaptureBuffer::CaptureBuffer(CaptureLog* log, int64_t openedAt) : log(log != nullptr && log->IsRecording() ? log : nullptr), sessionId(0)
+{
+	if (this->log == nullptr)
+		return;
+
+	sessionId = this->log->NextSessionId();
+	buffer.reserve(FLUSH_SIZE);
+	// Stamped with the accept, not when a worker took the socket from the queues
+	Write(this->log->Since(openedAt), CaptureFormat::RecordType::Open, nullptr, 0);
+}
+
+CaptureBuffer::~CaptureBuffer()
+{
+	if (log == nullptr)
+		return;
+
+	Record(CaptureFormat::RecordType::Close, nullptr, 0);
+	Flush();
+}
+
+void CaptureBuffer::Record(CaptureFormat::RecordType type, const char* data, uint32_t length)
+{
+	if (log == nullptr)
+		return;
+
+	// Write may stop the recording (log set to nullptr)
+	CaptureLog* const to = log;
+	const uint64_t now = to->Now();
+	Write(now, type, data, length);
+	to->AddOverhead(to->Now() - now);
+}
+
+void CaptureBuffer::Write(uint64_t timestamp, CaptureFormat::RecordType type, const char* data, uint32_t length)
+{
+	CaptureFormat::RecordHeader header{};
+	header.timestamp = timestamp;
+	header.sessionId = sessionId;
+	header.length = length;
+	header.type = type;
+
+	const char* raw = reinterpret_cast<const char*>(&header);
+	buffer.insert(buffer.end(), raw, raw + sizeof(header));
+	if (length > 0)
+		buffer.insert(buffer.end(), data, data + length);
+
+	if (buffer.size() >= FLUSH_SIZE)
+		Flush();
+}
+
+void CaptureBuffer::Flush()
+{
+	if (buffer.empty())
+		return;
+
+	// Stopped: this session records nothing more, the Truncated record ends it
+	if (not log->Append(sessionId, buffer.data(), buffer.size()))
+		log = nullptr;
+
+	buffer.clear();
+}
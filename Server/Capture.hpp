@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "CaptureFormat.hpp"
+
+namespace TCPMachine {
+
+	// Append only, memory mapped log of what the clients sent, replayed by the Replay tool.
+	// Space is reserved with a CAS on the write offset so the workers never take a lock.
+	// The first batch that does not fit stops the capture: a Truncated record ends the log
+	// (room for it is always kept) and nothing is recorded after it.
+	class CaptureLog {
+
+	public:
+
+		CaptureLog();
+		~CaptureLog();
+
+		CaptureLog(const CaptureLog&) = delete;
+		CaptureLog& operator=(const CaptureLog&) = delete;
+
+		// Map maxBytes of the file at path, the capture stops at the first batch that does not fit
+		// Return 0 if it succeed or -1 if it failed
+		int Open(const std::string& path, size_t maxBytes);
+		// Call once no session records anymore: trim the file & print the stats
+		void Close();
+
+		bool IsOpen() const;
+		// Open & not stopped by a full log
+		bool IsRecording() const;
+
+		uint64_t NextSessionId();
+		// ns since Open
+		uint64_t Now() const;
+		// ns since Open of a steady_clock time in ns, 0 if it is before Open
+		uint64_t Since(int64_t steadyNs) const;
+
+		// Copy a batch of records of sessionId into the log, return false if the capture stopped:
+		// the batch did not fit (it ends the log with a Truncated record) or an earlier one did not
+		bool Append(uint64_t sessionId, const char* records, size_t size);
+		// Time spent by the sessions recording, reported at Close as the capture overhead
+		void AddOverhead(uint64_t ns);
+
+	private:
+
+		int fd;
+		char* map;
+		size_t capacity;
+
+		// Set in offset once the Truncated record is written
+		static constexpr size_t STOPPED = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+		// Bytes of records written after the FileHeader, | STOPPED once the log is full
+		std::atomic<size_t> offset;
+		std::atomic<uint64_t> nextSessionId;
+		std::chrono::steady_clock::time_point start;
+
+		std::atomic<uint64_t> nbOfRecords;
+		std::atomic<uint64_t> nbOfDropped;
+		std::atomic<uint64_t> overheadNs;
+	};
+
+	// Records of one session, kept by its worker and appended to the log by batch
+	class CaptureBuffer {
+
+	public:
+
+		// Does nothing if log is nullptr or not recording
+		// openedAt: steady_clock ns of the accept, time of the Open record
+		CaptureBuffer(CaptureLog* log, int64_t openedAt);
+		// Record the Close & flush
+		~CaptureBuffer();
+
+		CaptureBuffer(const CaptureBuffer&) = delete;
+		CaptureBuffer& operator=(const CaptureBuffer&) = delete;
+
+		void Record(CaptureFormat::RecordType type, const char* data, uint32_t length);
+
+	private:
+
+		// Flushed to the log above this size
+		static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+		// nullptr once the capture stopped
+		CaptureLog* log;
+		uint64_t sessionId;
+		std::vector<char> buffer;
+
+		// Append a record to the buffer, flushed above FLUSH_SIZE
+		void Write(uint64_t timestamp, CaptureFormat::RecordType type, const char* data, uint32_t length);
+		void Flush();
+	};
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+namespace TCPMachine {
+
+	// Binary layout of a capture file, shared by the server (writer) and Replay (reader).
+	// FileHeader then RecordHeader + payload, in host byte order.
+	namespace CaptureFormat {
+
+		constexpr char MAGIC[8] = { 'T', 'C', 'P', 'M', 'C', 'A', 'P', '1' };
+
+		enum class RecordType : uint8_t {
+			// Session accepted, no payload
+			Open = 0,
+			// Bytes received from the client
+			Data = 1,
+			// Session closed, no payload
+			Close = 2,
+			// The log was full, nothing was recorded after it: the sessions without a Close end here.
+			// Session id of the batch that did not fit, no payload, always the last record
+			Truncated = 3
+		};
+
+		struct FileHeader {
+			char magic[8];
+			// Wall clock of the capture start in ns since epoch (informative)
+			uint64_t startedAt;
+			// Bytes of records after the header, 0 if the server did not close the capture
+			uint64_t length;
+		};
+
+		struct RecordHeader {
+			// ns since the capture start
+			uint64_t timestamp;
+			uint64_t sessionId;
+			// Payload bytes following the header
+			uint32_t length;
+			RecordType type;
+			uint8_t reserved[3];
+		};
+
+		static_assert(sizeof(FileHeader) == 24, "FileHeader must be packed");
+		static_assert(sizeof(RecordHeader) == 24, "RecordHeader must be packed");
+	}
+}
@@ -0,0 +1,108 @@
+#include "Endpoint.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <arpa/inet.h>
+
+using namespace TCPMachine;
+
+namespace {
+
+	// ::ffff:0:0/96
+	constexpr uint8_t V4_MAPPED_PREFIX[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+}
+
+Endpoint Endpoint::FromSockaddr(const struct sockaddr* addr, socklen_t len)
+{
+	Endpoint endpoint{};
+
+	// deal with both IPv4 and IPv6:
+	if (addr->sa_family == AF_INET && len >= sizeof(struct sockaddr_in))
+	{
+		auto* s = (const struct sockaddr_in*)addr;
+		std::memcpy(endpoint.address.data(), V4_MAPPED_PREFIX, sizeof(V4_MAPPED_PREFIX));
+		std::memcpy(endpoint.address.data() + sizeof(V4_MAPPED_PREFIX), &s->sin_addr, sizeof(s->sin_addr));
+		endpoint.port = ntohs(s->sin_port);
+	}
+	else if (addr->sa_family == AF_INET6 && len >= sizeof(struct sockaddr_in6))
+	{
+		auto* s = (const struct sockaddr_in6*)addr;
+		std::memcpy(endpoint.address.data(), &s->sin6_addr, sizeof(s->sin6_addr));
+		endpoint.port = ntohs(s->sin6_port);
+	}
+
+	return endpoint;
+}
+
+Endpoint Endpoint::FromSocket(const int fd)
+{
+	struct sockaddr_storage addr {};
+	socklen_t len = sizeof(addr);
+
+	if (getpeername(fd, (struct sockaddr*)&addr, &len) < 0)
+		return Endpoint{};
+
+	return FromSockaddr((struct sockaddr*)&addr, len);
+}
+
+const Endpoint::Address& Endpoint::GetAddress() const
+{
+	return address;
+}
+
+uint16_t Endpoint::GetPort() const
+{
+	return port;
+}
+
+bool Endpoint::IsV4() const
+{
+	return std::memcmp(address.data(), V4_MAPPED_PREFIX, sizeof(V4_MAPPED_PREFIX)) == 0;
+}
+
+size_t Endpoint::Format(char* buffer, size_t size) const
+{
+	char _ip[INET6_ADDRSTRLEN];
+
+	// Same text as inet_ntop on the dual stack listener: "::ffff:a.b.c.d" for IPv4 clients
+	if (inet_ntop(AF_INET6, address.data(), _ip, sizeof(_ip)) == nullptr)
+		_ip[0] = '\0';
+
+	int written = std::snprintf(buffer, size, "%s:%u", _ip, static_cast<unsigned>(port));
+
+	if (written < 0 || size == 0)
+		return 0;
+
+	return static_cast<size_t>(written) < size ? static_cast<size_t>(written) : size - 1;
+}
+
+bool Endpoint::operator==(const Endpoint& other) const
+{
+	return port == other.port && address == other.address;
+}
+
+bool Endpoint::operator!=(const Endpoint& other) const
+{
+	return not (*this == other);
+}
+
+bool Endpoint::operator<(const Endpoint& other) const
+{
+	if (address != other.address)
+		return address < other.address;
+
+	return port < other.port;
+}
+
+size_t Endpoint::Hash::operator()(const Endpoint& endpoint) const
+{
+	uint64_t lo, hi;
+	std::memcpy(&lo, endpoint.address.data(), sizeof(lo));
+	std::memcpy(&hi, endpoint.address.data() + sizeof(lo), sizeof(hi));
+
+	// splitmix64 finalizer over both halves & the port
+	uint64_t h = lo ^ (hi * 0x9E3779B97F4A7C15ULL) ^ (static_cast<uint64_t>(endpoint.port) << 48);
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return static_cast<size_t>(h ^ (h >> 31));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+namespace TCPMachine {
+
+	// Peer address of a session kept in binary form: 16 bytes (IPv4 mapped to IPv6) + port.
+	// Hashable & comparable to be used as a map key, formatted to text only on demand.
+	class Endpoint {
+
+	public:
+
+		using Address = std::array<uint8_t, 16>;
+
+		// "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255:65535" + '\0'
+		static constexpr size_t FORMAT_MAX = INET6_ADDRSTRLEN + 6;
+
+		// Trivial so a table of Endpoint is not touched until used, use Endpoint{} for a zeroed one
+		Endpoint() = default;
+
+		// From the address returned by accept() / getpeername()
+		static Endpoint FromSockaddr(const struct sockaddr* addr, socklen_t len);
+		// Ask the kernel with getpeername(), zeroed Endpoint if it failed
+		static Endpoint FromSocket(const int fd);
+
+		const Address& GetAddress() const;
+		uint16_t GetPort() const;
+		bool IsV4() const;
+
+		// Write "IP:PORT" with a '\0' in buffer, return the nb of chars written without the '\0'
+		// A buffer of FORMAT_MAX chars is always big enough
+		size_t Format(char* buffer, size_t size) const;
+
+		bool operator==(const Endpoint& other) const;
+		bool operator!=(const Endpoint& other) const;
+		bool operator<(const Endpoint& other) const;
+
+		struct Hash {
+			size_t operator()(const Endpoint& endpoint) const;
+		};
+
+	private:
+
+		Address address;
+		// Host byte order
+		uint16_t port;
+	};
+}
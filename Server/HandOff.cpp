@@ -0,0 +1,334 @@
+#include "HandOff.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+using namespace TCPMachine;
+
+namespace {
+
+	// Linux refuses more than SCM_MAX_FD (253) fds in one message
+	constexpr uint32_t MAX_FDS_PER_MSG = 250;
+
+	// Sent along each batch of fds
+	struct Header {
+		uint32_t count;
+		uint32_t more;
+	};
+
+	int MakeUnixAddress(const std::string& path, struct sockaddr_un* addr)
+	{
+		*addr = {};
+		addr->sun_family = AF_UNIX;
+
+		if (path.size() >= sizeof(addr->sun_path))
+		{
+			std::cerr << "[HANDOFF] : Unix socket path too long: " << path << std::endl;
+			return -1;
+		}
+
+		path.copy(addr->sun_path, path.size());
+		return 0;
+	}
+
+	// Create the directory of path (0700) if needed, then check only we can reach the socket in it:
+	// a directory of ours, not a symlink, no access for the group & others
+	int PrivateDirectory(const std::string& path)
+	{
+		const size_t slash = path.find_last_of('/');
+		const std::string dir = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+
+		if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST)
+		{
+			std::cerr << "[HANDOFF] : Could not create " << dir << std::endl;
+			return -1;
+		}
+
+		struct stat info {};
+
+		if (lstat(dir.c_str(), &info) < 0 || not S_ISDIR(info.st_mode) || info.st_uid != geteuid() || (info.st_mode & 077) != 0)
+		{
+			std::cerr << "[HANDOFF] : " << dir << " must be a directory owned by us with mode 0700" << std::endl;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	// The fds only go to (and come from) a process of our own user
+	bool SameUser(const int sock)
+	{
+		struct ucred cred {};
+		socklen_t len = sizeof(cred);
+
+		if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || len != sizeof(cred))
+			return false;
+
+		return cred.uid == geteuid();
+	}
+
+	int SendBatch(const int sock, const int* fds, const uint32_t count, const bool more)
+	{
+		Header header{ count, more ? 1u : 0u };
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS_PER_MSG)] {};
+
+		struct iovec iov {};
+		iov.iov_base = &header;
+		iov.iov_len = sizeof(header);
+
+		struct msghdr msg {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+		std::copy(fds, fds + count, reinterpret_cast<int*>(CMSG_DATA(cmsg)));
+
+		if (sendmsg(sock, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(header)))
+		{
+			std::cerr << "[HANDOFF] : sendmsg() failed" << std::endl;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	int RecvBatch(const int sock, std::vector<int>* fds, bool* more)
+	{
+		Header header{};
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS_PER_MSG)] {};
+
+		struct iovec iov {};
+		iov.iov_base = &header;
+		iov.iov_len = sizeof(header);
+
+		struct msghdr msg {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL) != static_cast<ssize_t>(sizeof(header)))
+		{
+			std::cerr << "[HANDOFF] : recvmsg() failed" << std::endl;
+			return -1;
+		}
+
+		uint32_t received = 0;
+
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+
+			const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+			received = static_cast<uint32_t>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+			fds->insert(fds->end(), data, data + received);
+		}
+
+		if ((msg.msg_flags & MSG_CTRUNC) || received != header.count)
+		{
+			std::cerr << "[HANDOFF] : Expected " << header.count << " fds but received " << received << std::endl;
+			return -1;
+		}
+
+		*more = header.more != 0;
+		return 0;
+	}
+}
+
+int HandOff::Send(const std::string& path, const int listenFd, const std::vector<int>& fds, std::chrono::milliseconds timeout)
+{
+	struct sockaddr_un addr;
+
+	if (MakeUnixAddress(path, &addr) < 0 || PrivateDirectory(path) < 0)
+		return -1;
+
+	// ================== Wait for the new process ==================
+	int serverfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (serverfd < 0)
+	{
+		std::cerr << "[HANDOFF] : Socket Creation Failed" << std::endl;
+		return -1;
+	}
+
+	unlink(path.c_str());
+
+	if (bind(serverfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(serverfd, 1) < 0)
+	{
+		std::cerr << "[HANDOFF] : Could not listen on " << path << std::endl;
+		close(serverfd);
+		return -1;
+	}
+	std::cout << "[HANDOFF] : Waiting for the new process on " << path << std::endl;
+
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+	struct pollfd pfd { serverfd, POLLIN, 0 };
+	int peer = -1;
+
+	while (peer < 0)
+	{
+		const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+
+		if (left.count() <= 0 || poll(&pfd, 1, static_cast<int>(left.count())) <= 0)
+			break;
+
+		peer = accept4(serverfd, nullptr, nullptr, SOCK_CLOEXEC);
+
+		// Another user: refused, keep waiting for the new process
+		if (peer >= 0 && not SameUser(peer))
+		{
+			std::cerr << "[HANDOFF] : Refused a process of another user" << std::endl;
+			close(peer);
+			peer = -1;
+		}
+	}
+
+	close(serverfd);
+	unlink(path.c_str());
+
+	if (peer < 0)
+	{
+		std::cerr << "[HANDOFF] : No process took over the listener" << std::endl;
+		return -1;
+	}
+
+	// ================== Send the fds by batch ==================
+	std::vector<int> all;
+	all.reserve(fds.size() + 1);
+	all.push_back(listenFd);
+	all.insert(all.end(), fds.begin(), fds.end());
+
+	size_t offset = 0;
+
+	while (offset < all.size())
+	{
+		uint32_t count = static_cast<uint32_t>(std::min<size_t>(all.size() - offset, MAX_FDS_PER_MSG));
+
+		if (SendBatch(peer, all.data() + offset, count, offset + count < all.size()) < 0)
+		{
+			close(peer);
+			return -1;
+		}
+
+		offset += count;
+	}
+
+	// ================== Wait for the ack ==================
+	// Until the new process acks, the fds are still ours to close or to serve
+	char ack = 0;
+	pfd = { peer, POLLIN, 0 };
+
+	if (poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0 || recv(peer, &ack, sizeof(ack), 0) != sizeof(ack))
+	{
+		std::cerr << "[HANDOFF] : New process did not acknowledge the fds" << std::endl;
+		close(peer);
+		return -1;
+	}
+
+	close(peer);
+	std::cout << "[HANDOFF] : Listener and " << fds.size() << " queued sockets handed off" << std::endl;
+
+	return 0;
+}
+
+int HandOff::Recv(const std::string& path, int* listenFd, std::vector<int>* fds, std::chrono::milliseconds timeout)
+{
+	struct sockaddr_un addr;
+
+	if (MakeUnixAddress(path, &addr) < 0 || PrivateDirectory(path) < 0)
+		return -1;
+
+	// ================== Connect to the old process ==================
+	// The old process only listens once it has been asked to hand off, retry until then
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+	int sock = -1;
+
+	while (true)
+	{
+		sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+		if (sock < 0)
+		{
+			std::cerr << "[HANDOFF] : Socket Creation Failed" << std::endl;
+			return -1;
+		}
+
+		if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+			break;
+
+		close(sock);
+
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			std::cerr << "[HANDOFF] : Could not connect to " << path << std::endl;
+			return -1;
+		}
+
+		// The old process stopped accepting before it listens here, clients wait in the backlog until we connect
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+
+	if (not SameUser(sock))
+	{
+		std::cerr << "[HANDOFF] : " << path << " is held by a process of another user" << std::endl;
+		close(sock);
+		return -1;
+	}
+	std::cout << "[HANDOFF] : Connected to the old process on " << path << std::endl;
+
+	// ================== Receive the fds ==================
+	std::vector<int> all;
+	bool more = true;
+
+	while (more)
+	{
+		if (RecvBatch(sock, &all, &more) < 0)
+		{
+			for (int fd : all)
+				close(fd);
+
+			close(sock);
+			return -1;
+		}
+	}
+
+	if (all.empty())
+	{
+		std::cerr << "[HANDOFF] : No listener received" << std::endl;
+		close(sock);
+		return -1;
+	}
+
+	char ack = 1;
+	if (send(sock, &ack, sizeof(ack), MSG_NOSIGNAL) != sizeof(ack))
+	{
+		std::cerr << "[HANDOFF] : Failed to acknowledge the fds" << std::endl;
+
+		for (int fd : all)
+			close(fd);
+
+		close(sock);
+		return -1;
+	}
+
+	close(sock);
+
+	*listenFd = all.front();
+	fds->assign(all.begin() + 1, all.end());
+	std::cout << "[HANDOFF] : Received listener and " << fds->size() << " queued sockets" << std::endl;
+
+	return 0;
+}
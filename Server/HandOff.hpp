@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace TCPMachine {
+
+	// Hot restart: pass the listening socket and the queued client sockets
+	// to a new process over a Unix domain socket using SCM_RIGHTS.
+	namespace HandOff {
+
+		// Old process: bind a Unix socket on path, wait for the new process to connect
+		// and send it the listener + client fds. Return 0 if it succeed or -1 if it failed
+		int Send(const std::string& path, const int listenFd, const std::vector<int>& fds, std::chrono::milliseconds timeout);
+
+		// New process: connect to the Unix socket on path (retry until timeout) and
+		// receive the listener + client fds. Return 0 if it succeed or -1 if it failed
+		int Recv(const std::string& path, int* listenFd, std::vector<int>* fds, std::chrono::milliseconds timeout);
+	}
+}
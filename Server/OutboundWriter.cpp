@@ -0,0 +1,98 @@
+#include "OutboundWriter.hpp"
+
+#include <cerrno>
+#include <iostream>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+using namespace TCPMachine;
+
+// Id of the wake up event, a session id is never 0
+#define WAKE_ID 0
+
+OutboundWriter::OutboundWriter(SessionRegistry* registry) : registry(registry)
+{
+	// Created once so a Watch racing Stop never uses a closed (or reused) fd
+	this->epfd = epoll_create1(EPOLL_CLOEXEC);
+	this->wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	this->running.store(false);
+
+	if (epfd >= 0 && wakefd >= 0)
+	{
+		struct epoll_event event {};
+		event.events = EPOLLIN;
+		event.data.u64 = WAKE_ID;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &event);
+	}
+}
+
+OutboundWriter::~OutboundWriter()
+{
+	Stop();
+
+	if (epfd >= 0)
+		close(epfd);
+
+	if (wakefd >= 0)
+		close(wakefd);
+}
+
+int OutboundWriter::Start()
+{
+	if (epfd < 0 || wakefd < 0)
+	{
+		std::cerr << "[WRITER] : epoll is not available" << std::endl;
+		return -1;
+	}
+
+	if (running.exchange(true))
+		return -1;
+
+	thread = std::thread(&OutboundWriter::Run, this);
+	return 0;
+}
+
+void OutboundWriter::Stop()
+{
+	if (not running.exchange(false))
+		return;
+
+	const uint64_t one = 1;
+	if (write(wakefd, &one, sizeof(one)) < 0)
+		std::cerr << "[WRITER] : Could not wake the writer up" << std::endl;
+
+	if (thread.joinable())
+		thread.join();
+}
+
+void OutboundWriter::Watch(uint64_t id, int fd)
+{
+	if (not running.load(std::memory_order_relaxed))
+		return;
+
+	struct epoll_event event {};
+	event.events = EPOLLOUT | EPOLLONESHOT;
+	event.data.u64 = id;
+
+	// Re-armed if it fired before, added the first time (a closed socket leaves the set on its own)
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &event) < 0 && errno == ENOENT)
+		epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+void OutboundWriter::Run()
+{
+	struct epoll_event events[256];
+
+	while (running.load())
+	{
+		const int nb = epoll_wait(epfd, events, 256, -1);
+
+		for (int i = 0; i < nb; i++)
+		{
+			// A socket still full or broken: the session watches it again or its worker sees the error
+			if (events[i].data.u64 != WAKE_ID)
+				registry->SendQueued(events[i].data.u64);
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+#include "SessionRegistry.hpp"
+
+namespace TCPMachine {
+
+	// Finishes the frames a full socket held back. A session that could not send all its queued
+	// frames without blocking (a publisher, the flusher) watches its socket here, the thread sends
+	// the rest as soon as it is writable (epoll EPOLLOUT, one shot) instead of waiting for the next
+	// Send* of the handler or the next publish. Keyed by the session id, a session gone is skipped.
+	class OutboundWriter {
+
+	public:
+
+		// registry: the watched ids are looked up there
+		explicit OutboundWriter(SessionRegistry* registry);
+		~OutboundWriter();
+
+		// Start the thread, return -1 if it already runs or epoll is not available
+		int Start();
+		// Join the thread, the watches left are dropped with the sockets
+		void Stop();
+
+		// Send the queued frames of the session id once fd is writable, safe from any thread
+		// Ignored while the thread is not running
+		void Watch(uint64_t id, int fd);
+
+	private:
+
+		SessionRegistry* registry;
+
+		// Sockets watched, the event holds the session id
+		int epfd;
+		// Written by Stop to wake the thread up
+		int wakefd;
+		std::atomic_bool running;
+		std::thread thread;
+
+		// Send the frames of the writable sockets until Stop
+		void Run();
+	};
+}
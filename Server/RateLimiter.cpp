@@ -0,0 +1,186 @@
+#include "RateLimiter.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace TCPMachine;
+
+namespace {
+
+	int64_t NowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+size_t RateLimiter::KeyHash::operator()(const Key& key) const
+{
+	uint64_t lo, hi;
+	std::memcpy(&lo, key.data(), sizeof(lo));
+	std::memcpy(&hi, key.data() + sizeof(lo), sizeof(hi));
+
+	// Mix both halves (splitmix64 finalizer), IPv4 mapped keys only differ in the high half
+	uint64_t h = lo ^ (hi * 0x9E3779B97F4A7C15ULL);
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return static_cast<size_t>(h ^ (h >> 31));
+}
+
+RateLimiter::RateLimiter(const Config& config) : config(config)
+{
+}
+
+int64_t RateLimiter::Check(const Key& address, Bucket bucket, uint32_t cost)
+{
+	const Limit& limit = GetLimit(bucket);
+
+	if (limit.rate <= 0)
+		return 0;
+
+	const int64_t now = NowNs();
+	const Key key = Prefix(address);
+	Shard& shard = ShardOf(key);
+
+	std::unique_lock<std::mutex> lock(shard.guard);
+
+	Client* client = nullptr;
+	auto it = shard.clients.find(key);
+
+	if (it != shard.clients.end())
+		client = &it->second;
+	else
+	{
+		if (shard.clients.size() >= MAX_CLIENTS_PER_SHARD && now - shard.pruned >= PRUNE_INTERVAL_NS)
+		{
+			Prune(shard, now);
+			shard.pruned = now;
+		}
+
+		// Still full: every client is active, the new ones share the overflow buckets
+		if (shard.clients.size() < MAX_CLIENTS_PER_SHARD)
+			client = &shard.clients.emplace(key, NewClient(now)).first->second;
+		else
+		{
+			if (not shard.hasOverflow)
+			{
+				shard.overflow = NewClient(now);
+				shard.hasOverflow = true;
+			}
+
+			client = &shard.overflow;
+		}
+	}
+
+	// ================== Lazy refill ==================
+	State& state = client->buckets[static_cast<int>(bucket)];
+	state.tokens = std::min(limit.burst, state.tokens + static_cast<double>(now - state.last) * 1e-9 * limit.rate);
+	state.last = now;
+
+	if (state.tokens >= cost)
+	{
+		state.tokens -= cost;
+		return 0;
+	}
+
+	if (limit.action != Action::Delay)
+		return -1;
+
+	// Go in debt, the caller waits until the bucket is back to 0
+	state.tokens -= cost;
+	return static_cast<int64_t>(std::ceil(-state.tokens / limit.rate * 1e6));
+}
+
+void RateLimiter::Refund(const Key& address, Bucket bucket, uint32_t cost)
+{
+	const Limit& limit = GetLimit(bucket);
+
+	if (limit.rate <= 0)
+		return;
+
+	const Key key = Prefix(address);
+	Shard& shard = ShardOf(key);
+
+	std::unique_lock<std::mutex> lock(shard.guard);
+
+	// Not in the table since its Check: it took the tokens from the overflow buckets
+	auto it = shard.clients.find(key);
+	Client* client = it != shard.clients.end() ? &it->second : shard.hasOverflow ? &shard.overflow : nullptr;
+
+	if (client == nullptr)
+		return;
+
+	// Not refilled here, the next Check does it from the same last time
+	State& state = client->buckets[static_cast<int>(bucket)];
+	state.tokens = std::min(limit.burst, state.tokens + cost);
+}
+
+RateLimiter::Shard& RateLimiter::ShardOf(const Key& key)
+{
+	// The map uses the low bits, pick the shard with the high ones
+	const size_t hash = KeyHash()(key);
+	return shards[(hash >> (sizeof(size_t) * 8 - 8)) & (NB_OF_SHARDS - 1)];
+}
+
+RateLimiter::Client RateLimiter::NewClient(int64_t now) const
+{
+	Client client{};
+	client.buckets[static_cast<int>(Bucket::Connections)] = { config.connections.burst, now };
+	client.buckets[static_cast<int>(Bucket::Messages)] = { config.messages.burst, now };
+	client.buckets[static_cast<int>(Bucket::Bytes)] = { config.bytes.burst, now };
+	return client;
+}
+
+RateLimiter::Key RateLimiter::Prefix(const Key& address)
+{
+	// ::ffff:a.b.c.d, the IPv4 address is the client
+	static const uint8_t V4_MAPPED[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+	if (std::memcmp(address.data(), V4_MAPPED, sizeof(V4_MAPPED)) == 0)
+		return address;
+
+	Key prefix{};
+	std::memcpy(prefix.data(), address.data(), 8);
+	return prefix;
+}
+
+RateLimiter::Action RateLimiter::GetAction(Bucket bucket) const
+{
+	return GetLimit(bucket).action;
+}
+
+const RateLimiter::Limit& RateLimiter::GetLimit(Bucket bucket) const
+{
+	switch (bucket)
+	{
+	case Bucket::Connections:
+		return config.connections;
+	case Bucket::Messages:
+		return config.messages;
+	default:
+		return config.bytes;
+	}
+}
+
+void RateLimiter::Prune(Shard& shard, int64_t now)
+{
+	const Limit* limits[3] = { &config.connections, &config.messages, &config.bytes };
+
+	for (auto it = shard.clients.begin(); it != shard.clients.end();)
+	{
+		bool idle = true;
+
+		for (int i = 0; i < 3 && idle; i++)
+		{
+			const State& state = it->second.buckets[i];
+
+			if (limits[i]->rate > 0)
+				idle = state.tokens + static_cast<double>(now - state.last) * 1e-9 * limits[i]->rate >= limits[i]->burst;
+		}
+
+		if (idle)
+			it = shard.clients.erase(it);
+		else
+			++it;
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+#include "Endpoint.hpp"
+
+namespace TCPMachine {
+
+	// Per client token buckets on connections/sec, messages/sec & bytes/sec.
+	// Clients are keyed by their binary IP address (IPv4 mapped to IPv6) so every
+	// bot behind a NAT shares the same buckets, and IPv6 clients by their /64: one
+	// subscriber gets a whole /64 and can rotate through it. The table is split in
+	// shards with one mutex each and buckets are refilled lazily when checked.
+	// A shard holds MAX_CLIENTS_PER_SHARD clients at most, the new clients of a full
+	// shard share its overflow buckets until idle ones are forgotten.
+	class RateLimiter {
+
+	public:
+
+		// What to do with a client over its limit
+		enum class Action {
+			// Take the tokens anyway and wait until they are refilled
+			Delay,
+			// Refuse the connection or the message, the session keeps going
+			Reject,
+			// Refuse and close the session
+			Disconnect
+		};
+
+		enum class Bucket {
+			Connections,
+			Messages,
+			Bytes
+		};
+
+		struct Limit {
+			// Tokens per second, 0 means unlimited
+			double rate = 0;
+			// Size of the bucket, must be >= the biggest cost checked at once (e.g. a message)
+			double burst = 0;
+			Action action = Action::Delay;
+		};
+
+		struct Config {
+			Limit connections;
+			Limit messages;
+			Limit bytes;
+		};
+
+		// Endpoint address without the port: IPv6 or IPv4 mapped address (::ffff:a.b.c.d)
+		// Check keeps only the /64 of an IPv6 address
+		using Key = Endpoint::Address;
+
+		explicit RateLimiter(const Config& config);
+
+		// Take cost tokens from the bucket of the client at address
+		// Return 0 if allowed now, the nb of microseconds to wait if the action is Delay
+		// or -1 if refused (Reject & Disconnect)
+		int64_t Check(const Key& address, Bucket bucket, uint32_t cost);
+		// Give back cost tokens taken by Check, for a message refused on another bucket
+		void Refund(const Key& address, Bucket bucket, uint32_t cost);
+
+		Action GetAction(Bucket bucket) const;
+
+	private:
+
+		struct KeyHash {
+			size_t operator()(const Key& key) const;
+		};
+
+		struct State {
+			double tokens;
+			// steady_clock time of the last refill in ns
+			int64_t last;
+		};
+
+		struct Client {
+			State buckets[3];
+		};
+
+		// Padded so two workers using different shards do not share a cache line
+		struct alignas(64) Shard {
+			std::mutex guard;
+			std::unordered_map<Key, Client, KeyHash> clients;
+			// Shared by the clients that did not fit, created full on first use
+			Client overflow;
+			bool hasOverflow = false;
+			// steady_clock ns of the last Prune, a full shard is scanned once per PRUNE_INTERVAL_NS at most
+			int64_t pruned = 0;
+		};
+
+		// Power of 2 to pick the shard with a mask
+		static constexpr size_t NB_OF_SHARDS = 64;
+		// Above this nb of clients a shard forgets the ones with full buckets
+		static constexpr size_t MAX_CLIENTS_PER_SHARD = 4096;
+		// So a flood of new clients on a shard of active ones does not scan it for each of them
+		static constexpr int64_t PRUNE_INTERVAL_NS = 1000000000;
+
+		const Config config;
+		Shard shards[NB_OF_SHARDS];
+
+		const Limit& GetLimit(Bucket bucket) const;
+		Shard& ShardOf(const Key& key);
+		// Client with full buckets
+		Client NewClient(int64_t now) const;
+		// The address itself for IPv4, its first 64 bits for IPv6
+		static Key Prefix(const Key& address);
+
+		// Remove the clients whose buckets are all full again (idle), shard lock held
+		void Prune(Shard& shard, int64_t now);
+	};
+}
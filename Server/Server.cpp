@@ -1,4 +1,5 @@
 #include "Server.hpp"
+#include "HandOff.hpp"
 
 #include <iostream>
 #include <unistd.h>
@@ -6,14 +7,23 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <errno.h>
+#include <sys/eventfd.h>
 
 using namespace TCPMachine;
 
-Server::Server(uint16_t port, uint8_t nbWorkers) : sessions(nbWorkers)
+Server::Server(uint16_t port, size_t nbWorkers, const RateLimiter::Config& limits, SocketProfile profile) : limiter(limits), broadcaster(), capture(), registry(), sessions(nbWorkers, &limiter, &broadcaster, &capture, &registry)
 {
 	this->isRunning.store(false);
 	this->port = port;
+	this->profile = profile;
+	this->socketOptions = SocketProfiles::GetOptions(profile);
+	this->stopMode = StopMode::Immediate;
+	this->drainDeadline = std::chrono::milliseconds(0);
+	this->handOffResult = 0;
+	this->inheritedListenFd = -1;
+	this->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 }
 
 Server::~Server() 
@@ -22,6 +32,9 @@ Server::~Server()
 	{
 		Stop();
 	}	
+
+	if (wakeFd >= 0)
+		close(wakeFd);
 }
 
 int Server::Start()
@@ -37,6 +50,10 @@ int Server::Start()
 	if (not isRunning.is_lock_free())
 		return -1;
 
+	// Clear the wake up of the previous Stop
+	eventfd_t value = 0;
+	eventfd_read(wakeFd, &value);
+
 	isRunning.store(true);
 	
 	handle = std::thread(&Server::ListenerThread, this);
@@ -45,6 +62,121 @@ int Server::Start()
 }
 
 int Server::Stop()
+{
+	return Shutdown(StopMode::Immediate, std::chrono::milliseconds(0), "");
+}
+
+int Server::Drain(std::chrono::milliseconds deadline)
+{
+	return Shutdown(StopMode::Drain, deadline, "");
+}
+
+int Server::HandOffListener(const std::string& path, std::chrono::milliseconds deadline)
+{
+	return Shutdown(StopMode::HandOff, deadline, path);
+}
+
+int Server::TakeOver(const std::string& path, std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (isRunning.load() || inheritedListenFd >= 0)
+	{
+		std::cerr << "[ERROR] [SERVER] : Take over must happen once before Start...\n" << std::endl;
+		return -1;
+	}
+
+	std::vector<int> fds;
+
+	if (HandOff::Recv(path, &inheritedListenFd, &fds, timeout) < 0)
+		return -1;
+
+	// Queued until the workers start with the listener
+	for (int fd : fds)
+		sessions.Push(fd);
+
+	return 0;
+}
+
+int Server::StartCapture(const std::string& path, size_t maxBytes)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (isRunning.load())
+	{
+		std::cerr << "[ERROR] [SERVER] : Capture must start before the server...\n" << std::endl;
+		return -1;
+	}
+
+	return capture.Open(path, maxBytes);
+}
+
+int Server::SetTopology(const Topology& topology)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (isRunning.load())
+	{
+		std::cerr << "[ERROR] [SERVER] : Topology must be set before the server...\n" << std::endl;
+		return -1;
+	}
+
+	this->topology = topology;
+	return sessions.SetTopology(topology);
+}
+
+int Server::SetBatching(const Session::Batching& batching)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (isRunning.load())
+	{
+		std::cerr << "[ERROR] [SERVER] : Batching must be set before the server...\n" << std::endl;
+		return -1;
+	}
+
+	return sessions.SetBatching(batching);
+}
+
+int Server::SetHandler(SessionManager::Handler handler)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (isRunning.load())
+	{
+		std::cerr << "[ERROR] [SERVER] : Handler must be set before the server...\n" << std::endl;
+		return -1;
+	}
+
+	return sessions.SetHandler(std::move(handler));
+}
+
+size_t Server::Publish(const std::string& topic, const std::string& payload)
+{
+	return broadcaster.Publish(topic, payload);
+}
+
+std::vector<SessionRegistry::Info> Server::ListSessions()
+{
+	return registry.List();
+}
+
+int Server::QuerySession(uint64_t id, SessionRegistry::Info* info)
+{
+	return registry.Query(id, info) ? 0 : -1;
+}
+
+int Server::KillSession(uint64_t id)
+{
+	return registry.Kill(id) ? 0 : -1;
+}
+
+int Server::SendToSession(uint64_t id, const std::string& payload)
+{
+	return registry.SendTo(id, payload) ? 0 : -1;
+}
+
+int Server::Shutdown(StopMode mode, std::chrono::milliseconds deadline, const std::string& path)
 {
 	std::unique_lock<std::mutex> lock(guardStartStop);
 
@@ -53,20 +185,30 @@ int Server::Stop()
 		std::cerr << "[ERROR] [SERVER] : Server not started...\n" << std::endl;
 		return -1;
 	}
-		
+
+	stopMode = mode;
+	drainDeadline = deadline;
+	handOffPath = path;
+	handOffResult = 0;
+
 	isRunning.store(false);
+	eventfd_write(wakeFd, 1);
 
 	if (handle.joinable())
 		handle.join();
 	else
 		return -1;
 
-	return 0;
+	return handOffResult;
 }
 
 void Server::ListenerThread()
 {
-	int listen_sd = CreateListenSock();
+	// Pinned before the listener socket & the workers are created
+	Topologies::PinCurrentThread(topology.listenerCpus);
+
+	int listen_sd = inheritedListenFd >= 0 ? inheritedListenFd : CreateListenSock();
+	inheritedListenFd = -1;
 
 	if (listen_sd < 0) 
 		return;
@@ -82,13 +224,18 @@ void Server::ListenerThread()
 	// ================== Wait for connections ==================
 	while (isRunning.load())
 	{
-		int client_fd = accept(listen_sd, nullptr, nullptr);
+		// The peer comes with the accept, no getpeername() per session
+		struct sockaddr_storage addr;
+		socklen_t len = sizeof(addr);
+		int client_fd = accept4(listen_sd, (struct sockaddr*)&addr, &len, SOCK_CLOEXEC);
 
 		if (client_fd < 0)
 		{
 			if (errno == EWOULDBLOCK)
 			{
-				std::this_thread::sleep_for(std::chrono::seconds(1));
+				// Woken by the next client or by Shutdown, a hand off does not leave the backlog waiting
+				struct pollfd pfds[2] { { listen_sd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+				poll(pfds, wakeFd >= 0 ? 2 : 1, 100);
 				continue;
 			}
 			else
@@ -99,13 +246,49 @@ void Server::ListenerThread()
 		}
 
 		//  TO DO: Use poll() or select() to push only active sockets...
-		sessions.Push(client_fd);
+		// The options of the profile are inherited from the listener
+
+		// Run the session on the CPU of the RSS queue of the connection
+		int incomingCpu = topology.followIncomingCpu ? Topologies::GetIncomingCpu(client_fd) : -1;
+
+		sessions.Push(client_fd, Endpoint::FromSockaddr((struct sockaddr*)&addr, len), incomingCpu);
+	}
+	// ================== Hand off the listener ==================
+	if (stopMode == StopMode::HandOff)
+	{
+		std::vector<int> queued = sessions.TakeQueued();
+
+		if (HandOff::Send(handOffPath, listen_sd, queued, drainDeadline) < 0)
+		{
+			// Nobody took over: keep serving what was queued during the drain
+			std::cerr << "[ERROR] [SERVER] : Hand off failed, draining instead...\n" << std::endl;
+			handOffResult = -1;
+
+			for (int fd : queued)
+				sessions.Push(fd);
+		}
+		else
+		{
+			// The new process owns them now, close our copies
+			for (int fd : queued)
+				close(fd);
+		}
 	}
-	// ================== Stop Threads Workers ==================
-	sessions.StopWorkers();
 
 	// ================== Close the listener fd =================
+	// Closed before draining so new clients are refused instead of waiting in the backlog
 	close(listen_sd);
+
+	// ================== Stop Threads Workers ==================
+	if (stopMode == StopMode::Immediate)
+		sessions.StopWorkers();
+	else
+		sessions.DrainWorkers(drainDeadline);
+
+	// ================== Close the capture ==================
+	// No session records anymore once the workers are stopped
+	capture.Close();
+
 	std::cout << "[SERVER] : Listener Thread Gracefully Stopped" << std::endl;
 }
 
@@ -139,6 +322,12 @@ int Server::CreateListenSock()
 	}
 	std::cout << "[SERVER] : Socket Marked as Reuseable" << std::endl;
 
+	// ============ Apply the socket profile (before listen) ============
+	// A missing option (e.g. SO_BUSY_POLL without CAP_NET_ADMIN) is logged but not fatal
+	if (SocketProfiles::ApplyListener(serverfd, socketOptions) < 0)
+		std::cerr << "[SERVER] : Some options of the " << SocketProfiles::GetName(profile) << " profile are not set" << std::endl;
+	std::cout << "[SERVER] : Socket Profile " << SocketProfiles::GetName(profile) << " Applied" << std::endl;
+
 	// ================== Get Socket Flags ==================
 	if ((flags = fcntl(serverfd, F_GETFL, 0)) < 0)
 	{
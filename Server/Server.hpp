@@ -4,8 +4,16 @@
 #include <atomic>
 #include <mutex>
 #include <thread>
+#include <chrono>
+#include <string>
 
 #include "SessionManager.hpp"
+#include "RateLimiter.hpp"
+#include "SocketProfile.hpp"
+#include "Broadcaster.hpp"
+#include "Capture.hpp"
+#include "Topology.hpp"
+#include "SessionRegistry.hpp"
 
 namespace TCPMachine {
 
@@ -14,15 +22,64 @@ namespace TCPMachine {
 	public:
 
 		// Port of the server & nb of threads to handle a sessions at the same time
-		explicit Server(uint16_t port, uint8_t nbWorkers);
+		// limits: per client rate limits, unlimited by default
+		// profile: options of the listener & accepted sockets, kernel defaults by default
+		explicit Server(uint16_t port, size_t nbWorkers, const RateLimiter::Config& limits = RateLimiter::Config(), SocketProfile profile = SocketProfile::Default);
 		~Server();
 
 		// Start the listener in a new thread - Total threads: nbWorkers + 1
 		int Start();
+		// Stop accepting, shut down the active sessions & close the queued ones
 		int Stop();
+		// Stop accepting, let the queued & active sessions finish until the deadline then stop
+		int Drain(std::chrono::milliseconds deadline);
+		// Hot restart: hand the listener & the queued sockets to the process taking over on path,
+		// then drain the active sessions until the deadline. Return -1 if nobody took over
+		int HandOffListener(const std::string& path, std::chrono::milliseconds deadline);
+		// Call before Start: reuse the listener & queued sockets handed off by a running server
+		int TakeOver(const std::string& path, std::chrono::milliseconds timeout);
+
+		// Call before Start: record what the clients send to path (up to maxBytes) for the Replay tool
+		// The capture is closed when the server stops
+		int StartCapture(const std::string& path, size_t maxBytes);
+
+		// Call before Start: pin the listener & the workers, see Topologies::Spread
+		int SetTopology(const Topology& topology);
+		// Call before Start: coalesce the small writes of the sessions, see Session::Batching
+		int SetBatching(const Session::Batching& batching);
+		// Call before Start: what each session runs, see SessionManager::Handler
+		int SetHandler(SessionManager::Handler handler);
+
+		// Send the payload to every session subscribed to the topic (Broadcaster::ALL: all sessions)
+		// Return the nb of sessions it was queued to
+		size_t Publish(const std::string& topic, const std::string& payload);
+
+		// ================== Admin ==================
+		// Snapshot of the running sessions
+		std::vector<SessionRegistry::Info> ListSessions();
+		// Return -1 if there is no session with this id
+		int QuerySession(uint64_t id, SessionRegistry::Info* info);
+		// Shut the session down, return -1 if there is no session with this id
+		int KillSession(uint64_t id);
+		// Queue a message on one session, return -1 if it does not exist or its queue is full
+		int SendToSession(uint64_t id, const std::string& payload);
 
 	private:
 
+		enum class StopMode {
+			Immediate,
+			Drain,
+			HandOff
+		};
+
+		// Per client token buckets, must outlive the sessions
+		RateLimiter limiter;
+		// Topics of the sessions, must outlive the sessions
+		Broadcaster broadcaster;
+		// Record of the sessions, must outlive the sessions
+		CaptureLog capture;
+		// Running sessions by id, must outlive the sessions
+		SessionRegistry registry;
 		// Thread pool to manage sessions
 		SessionManager sessions;
 
@@ -32,10 +89,32 @@ namespace TCPMachine {
 		std::atomic_bool isRunning;
 		// ListenerThread
 		std::thread handle;
+		// Written by Shutdown so the listener stops waiting for a client right away (eventfd)
+		int wakeFd;
 
 		// Server Port
 		uint16_t port;
 
+		// Socket options of the listener & the accepted sockets
+		SocketProfile profile;
+		SocketOptions socketOptions;
+
+		// Placement of the listener & the workers
+		Topology topology;
+
+		// Set before isRunning goes false, read by the listener once it stopped accepting
+		StopMode stopMode;
+		std::chrono::milliseconds drainDeadline;
+		std::string handOffPath;
+		// Result of the hand off, written by the listener thread before it ends
+		int handOffResult;
+
+		// Listener received from TakeOver or -1 to create a new one
+		int inheritedListenFd;
+
+		// Common part of Stop, Drain & HandOffListener
+		int Shutdown(StopMode mode, std::chrono::milliseconds deadline, const std::string& path);
+
 		// Create a socket and listen for clients
 		void ListenerThread();
 
@@ -1,19 +1,40 @@
 #include "Session.hpp"
 
+#include "BatchFlusher.hpp"
+#include "OutboundWriter.hpp"
+
 #include <iostream>
+#include <cerrno>
+#include <ctime>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <stdexcept>
+#include <algorithm>
 
 using namespace TCPMachine;
 
 // ======================= PUBLIC: =======================
 
-Session::Session(const int fd) : fd(fd)
+Session::Session(const int fd, const Endpoint& peer, int64_t acceptedAt, RateLimiter* limiter, CaptureLog* capture, const Batching& batching) : fd(fd), limiter(limiter), outboundOffset(0), outboundInFlight(0), batching(batching), peer(peer), startedAt(acceptedAt), capture(capture, acceptedAt)
 {
-	SetIpAddress();
+	this->state.store(State::Admitting);
+	this->parkable = false;
+	this->heldLength = -1;
+	this->bytesIn.store(0);
+	this->bytesOut.store(0);
+	this->lastRecv.store(startedAt);
+	this->lastSend.store(startedAt);
+	this->batches.store(0);
+	this->batchedWrites.store(0);
+	this->batchedBytes.store(0);
+	this->batchDeadline.store(0);
+	this->nbOfEnqueued = 0;
+	this->flusher = nullptr;
+	this->writer = nullptr;
+	this->id = 0;
 }
 
 Session::~Session()
@@ -23,49 +44,396 @@ Session::~Session()
 	close(fd);
 }
 
-const std::string& Session::GetIpAddress() const
+int64_t Session::Admit()
+{
+	if (limiter == nullptr)
+		return 0;
+
+	return limiter->Check(peer.GetAddress(), RateLimiter::Bucket::Connections, 1);
+}
+
+void Session::Start()
+{
+	state.store(State::Running, std::memory_order_relaxed);
+	parkable = true;
+}
+
+void Session::Attach(uint64_t id, BatchFlusher* flusher, OutboundWriter* writer)
+{
+	this->id = id;
+	this->flusher = flusher;
+	this->writer = writer;
+}
+
+const Endpoint& Session::GetEndpoint() const
+{
+	return peer;
+}
+
+Session::Stats Session::GetStats() const
+{
+	Stats stats;
+	stats.state = state.load(std::memory_order_relaxed);
+	stats.bytesIn = bytesIn.load(std::memory_order_relaxed);
+	stats.bytesOut = bytesOut.load(std::memory_order_relaxed);
+	stats.startedAt = startedAt;
+	stats.lastActivity = std::max(lastRecv.load(std::memory_order_relaxed), lastSend.load(std::memory_order_relaxed));
+	stats.batches = batches.load(std::memory_order_relaxed);
+	stats.batchedWrites = batchedWrites.load(std::memory_order_relaxed);
+	stats.batchedBytes = batchedBytes.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+void Session::SetState(State state)
+{
+	this->state.store(state, std::memory_order_relaxed);
+}
+
+void Session::Shutdown()
+{
+	shutdown(fd, SHUT_RDWR);
+}
+
+void Session::Flush()
+{
+	{
+		std::unique_lock<std::mutex> lock(guardSend);
+
+		Seal();
+		FlushOutbound(true);
+		batchDeadline.store(0, std::memory_order_relaxed);
+	}
+
+	// Frames queued while we held the socket
+	TryFlush();
+}
+
+void Session::FlushExpired(int64_t now)
 {
-	return fullIp;
+	int64_t deadline = batchDeadline.load(std::memory_order_relaxed);
+
+	if (deadline == 0 || now < deadline)
+		return;
+
+	// The handler is appending to the batch or a publisher is sending, try again a quarter of the budget later
+	if (not guardSend.try_lock())
+	{
+		if (flusher != nullptr)
+			flusher->Schedule(id, now + std::chrono::duration_cast<std::chrono::nanoseconds>(batching.budget).count() / 4);
+
+		return;
+	}
+
+	Seal();
+
+	// Socket full: the writer sends the rest once it is writable
+	if (FlushOutbound(false))
+		batchDeadline.store(0, std::memory_order_relaxed);
+
+	guardSend.unlock();
+}
+
+bool Session::Enqueue(const SharedFrame& frame, size_t maxQueued, OverflowPolicy policy)
+{
+	{
+		std::unique_lock<std::mutex> lock(guardOutbound);
+
+		if (nbOfEnqueued >= maxQueued)
+		{
+			switch (policy)
+			{
+			case OverflowPolicy::Drop:
+				return false;
+
+			case OverflowPolicy::Disconnect:
+				// The worker of the session sees the error on its next recv/send
+				shutdown(fd, SHUT_RDWR);
+				return false;
+
+			case OverflowPolicy::CoalesceLatest:
+			{
+				// The frames being sent may be partially sent, keep them & the replies of the handler
+				auto first = outbound.begin() + std::min(outbound.size(), std::max<size_t>(1, outboundInFlight));
+				auto kept = std::remove_if(first, outbound.end(), [](const Queued& queued) { return not queued.own; });
+
+				nbOfEnqueued -= static_cast<size_t>(outbound.end() - kept);
+				outbound.erase(kept, outbound.end());
+				break;
+			}
+			}
+		}
+
+		outbound.push_back({ frame, false });
+		nbOfEnqueued++;
+	}
+
+	TryFlush();
+	return true;
+}
+
+void Session::SendQueued()
+{
+	TryFlush();
 }
 
 // ======================= PRIVATE: =======================
 
-void Session::SetIpAddress()
+int64_t Session::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t Session::CoarseNow()
+{
+	// steady_clock is CLOCK_MONOTONIC, the coarse one reads the last tick of the same clock
+	struct timespec now {};
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void Session::Count(std::atomic<uint64_t>& counter, std::atomic<int64_t>& last, size_t bytes)
+{
+	// Relaxed, the admin only needs a recent value
+	counter.fetch_add(bytes, std::memory_order_relaxed);
+	last.store(CoarseNow(), std::memory_order_relaxed);
+}
+
+int64_t Session::Throttle(RateLimiter::Bucket bucket, uint32_t cost)
 {
-	socklen_t len;
-	uint16_t port{ 0 };
-	struct sockaddr_storage addr {};
+	if (limiter == nullptr)
+		return 0;
 
-	len = sizeof addr;
-	getpeername(fd, (struct sockaddr*)&addr, &len);
+	int64_t wait = limiter->Check(peer.GetAddress(), bucket, cost);
+
+	if (wait < 0 && limiter->GetAction(bucket) == RateLimiter::Action::Disconnect)
+	{
+		shutdown(fd, SHUT_RDWR);
+		throw std::runtime_error("Rate limit exceeded, disconnecting");
+	}
+
+	return wait;
+}
 
-	char _ip[INET6_ADDRSTRLEN];
+void Session::SkipData(uint32_t total_bytes)
+{
+	char buffer[4096];
 
-	// deal with both IPv4 and IPv6:
-	if (addr.ss_family == AF_INET)
+	while (total_bytes > 0)
 	{
-		auto* s = (struct sockaddr_in*)&addr;
-		port = ntohs(s->sin_port);
-		inet_ntop(AF_INET, &s->sin_addr, _ip, sizeof(_ip));
+		uint32_t chunk = std::min<uint32_t>(total_bytes, sizeof(buffer));
+		RecvData(buffer, chunk);
+		total_bytes -= chunk;
 	}
-	else
+}
+
+void Session::TryFlush()
+{
+	// If the lock is taken, the holder checks the queue again once it released it
+	while (guardSend.try_lock())
+	{
+		bool drained = FlushOutbound(false);
+		guardSend.unlock();
+
+		if (not drained)
+			return;
+
+		std::unique_lock<std::mutex> lock(guardOutbound);
+		if (outbound.empty())
+			return;
+	}
+}
+
+bool Session::FlushOutbound(bool blocking)
+{
+	while (true)
+	{
+		// Referenced while sent, a publisher may drop them from the queue meanwhile
+		SharedFrame frames[MAX_IOV];
+		struct iovec iov[MAX_IOV];
+		size_t count = 0;
+		size_t total = 0;
+
+		{
+			std::unique_lock<std::mutex> lock(guardOutbound);
+
+			if (outbound.empty())
+				return true;
+
+			for (auto it = outbound.begin(); it != outbound.end() && count < MAX_IOV; ++it, count++)
+			{
+				size_t offset = count == 0 ? outboundOffset : 0;
+
+				frames[count] = it->frame;
+				iov[count].iov_base = const_cast<char*>(it->frame->data()) + offset;
+				iov[count].iov_len = it->frame->size() - offset;
+				total += iov[count].iov_len;
+			}
+
+			outboundInFlight = count;
+		}
+
+		// ================== Send them at once ==================
+		struct msghdr msg {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+
+		size_t sent = 0;
+		bool failed = false;
+		bool full = false;
+
+		while (sent < total)
+		{
+			// MSG_NOSIGNAL: a peer gone must not raise SIGPIPE
+			ssize_t iResult = sendmsg(fd, &msg, MSG_NOSIGNAL | (blocking ? 0 : MSG_DONTWAIT));
+
+			// Socket full (EAGAIN) or broken, the worker of the session will find out
+			if (iResult <= 0)
+			{
+				full = iResult < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+				failed = true;
+				break;
+			}
+
+			sent += static_cast<size_t>(iResult);
+
+			if (not blocking)
+				break;
+
+			// Skip what was sent, partially sent iov included
+			size_t skip = static_cast<size_t>(iResult);
+			while (skip > 0 && skip >= msg.msg_iov->iov_len)
+			{
+				skip -= msg.msg_iov->iov_len;
+				msg.msg_iov++;
+				msg.msg_iovlen--;
+			}
+
+			if (skip > 0)
+			{
+				msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + skip;
+				msg.msg_iov->iov_len -= skip;
+			}
+		}
+
+		// ================== Pop what was fully sent ==================
+		{
+			std::unique_lock<std::mutex> lock(guardOutbound);
+
+			outboundInFlight = 0;
+			outboundOffset += sent;
+
+			while (not outbound.empty() && outboundOffset >= outbound.front().frame->size())
+			{
+				outboundOffset -= outbound.front().frame->size();
+				nbOfEnqueued -= outbound.front().own ? 0 : 1;
+				outbound.pop_front();
+			}
+		}
+
+		if (sent > 0)
+			Count(bytesOut, lastSend, sent);
+
+		if (failed && blocking)
+			throw std::runtime_error("Failed to send data");
+
+		// A partial send means the socket is full as well
+		if ((full || (not failed && sent < total)) && writer != nullptr)
+			writer->Watch(id, fd);
+
+		if (failed || sent < total)
+			return false;
+	}
+}
+
+void Session::Seal()
+{
+	if (batch.empty())
+		return;
+
+	batches.fetch_add(1, std::memory_order_relaxed);
+	batchedBytes.fetch_add(batch.size(), std::memory_order_relaxed);
+
+	// Behind the frames queued so far, never dropped by the overflow policy
+	SharedFrame frame = std::make_shared<const std::string>(std::move(batch));
+	batch.clear();
+
+	std::unique_lock<std::mutex> lock(guardOutbound);
+	outbound.push_back({ std::move(frame), true });
+}
+
+void Session::Write(const char* head, uint32_t headBytes, const char* body, uint32_t bodyBytes)
+{
+	// Called by the handler only, the publishers use Enqueue
+	parkable = false;
+
 	{
-		// AF_INET6
-		auto* s = (struct sockaddr_in6*)&addr;
-		port = ntohs(s->sin6_port);
-		inet_ntop(AF_INET6, &s->sin6_addr, _ip, sizeof(_ip));
+		std::unique_lock<std::mutex> lock(guardSend);
+
+		if (batching.budget.count() > 0 && bodyBytes >= batching.maxBytes)
+		{
+			// Not worth a copy: the header leaves with the batch, the body right after from the buffer of the caller
+			batch.append(head, headBytes);
+			batchedWrites.fetch_add(1, std::memory_order_relaxed);
+			Seal();
+			FlushOutbound(true);
+			batchDeadline.store(0, std::memory_order_relaxed);
+
+			WriteAll(body, bodyBytes);
+		}
+		else if (batching.budget.count() > 0)
+		{
+			if (batch.empty())
+			{
+				const int64_t deadline = Now() + std::chrono::duration_cast<std::chrono::nanoseconds>(batching.budget).count();
+				batchDeadline.store(deadline, std::memory_order_relaxed);
+
+				if (flusher != nullptr)
+					flusher->Schedule(id, deadline);
+			}
+
+			batch.append(head, headBytes);
+
+			if (bodyBytes > 0)
+				batch.append(body, bodyBytes);
+			batchedWrites.fetch_add(1, std::memory_order_relaxed);
+
+			if (batch.size() < batching.maxBytes)
+				return;
+
+			// Full, sent now with the queued frames
+			Seal();
+			FlushOutbound(true);
+			batchDeadline.store(0, std::memory_order_relaxed);
+		}
+		else
+		{
+			// Queued frames first, a partially sent one must be completed before anything else
+			FlushOutbound(true);
+			WriteAll(head, headBytes);
+
+			if (bodyBytes > 0)
+				WriteAll(body, bodyBytes);
+		}
 	}
 
-	fullIp = std::string(_ip) + ':' + std::to_string(port);
+	// Frames queued while we held the socket
+	TryFlush();
 }
 
 void Session::SendData(const char* buffer, uint32_t total_bytes)
+{
+	Write(buffer, total_bytes, nullptr, 0);
+}
+
+void Session::WriteAll(const char* buffer, uint32_t total_bytes)
 {
 	uint32_t bytes_sent = 0;
 
 	while (bytes_sent < total_bytes)
 	{						
-		int32_t iResult = static_cast<int32_t>(send(fd, buffer + bytes_sent, total_bytes - bytes_sent, 0));
+		// MSG_NOSIGNAL: a peer gone (or a socket shut down by a drain) must not raise SIGPIPE
+		int32_t iResult = static_cast<int32_t>(send(fd, buffer + bytes_sent, total_bytes - bytes_sent, MSG_NOSIGNAL));
 	
 		if (iResult < 0)
 			throw std::runtime_error("Failed to send data");
@@ -76,10 +444,18 @@ void Session::SendData(const char* buffer, uint32_t total_bytes)
 
 	if (bytes_sent != total_bytes)
 		throw std::runtime_error("Sent " + std::to_string(bytes_sent) + " bytes instead of " + std::to_string(total_bytes) + "bytes");
+
+	Count(bytesOut, lastSend, bytes_sent);
 }
 
 void Session::RecvData(char* buffer, uint32_t total_bytes)
 {
+	parkable = false;
+
+	// Waiting for the client ends the exchange, it must get our replies first
+	if (batchDeadline.load(std::memory_order_relaxed) != 0)
+		Flush();
+
 	uint32_t bytes_received = 0;
 
 	while (bytes_received < total_bytes)
@@ -89,12 +465,20 @@ void Session::RecvData(char* buffer, uint32_t total_bytes)
 		if (iResult < 0)
 			throw std::runtime_error("Failed to receive data");
 
+		if (iResult == 0)
+			throw std::runtime_error("Connection closed by peer");
+
 		// iResult here is always >= 0 meaning we can add it to an unsigned int
 		bytes_received += iResult;
 	}
 
 	if (bytes_received != total_bytes)
 		throw std::runtime_error("Received " + std::to_string(bytes_received) + " bytes instead of " + std::to_string(total_bytes) + "bytes");
+
+	Count(bytesIn, lastRecv, bytes_received);
+
+	// Raw bytes so a replay sends exactly what the client did
+	capture.Record(CaptureFormat::RecordType::Data, buffer, total_bytes);
 }
 
 // INT32
@@ -139,27 +523,87 @@ void Session::SendBoolean(const bool value)
 
 void Session::RecvBoolean(bool* value)
 {
-	RecvData(reinterpret_cast<char*>(&value), sizeof(bool));
+	// Any byte but 0 is true, a bool holding another value than 0 or 1 is undefined
+	uint8_t byte = 0;
+	RecvData(reinterpret_cast<char*>(&byte), sizeof(byte));
+	*value = byte != 0;
 }
 
 // STD::STRING
 void Session::SendString(const std::string& str)
 {
 	uint32_t buff_len = static_cast<uint32_t>(str.size());
+	// Convert from Host Byte Order to Network Byte Order
+	uint32_t netUint = htonl(buff_len);
 
-	SendUint32(buff_len);
-	SendData(str.c_str(), buff_len);
+	// Length & payload in one Write so no queued frame lands in between
+	Write(reinterpret_cast<const char*>(&netUint), sizeof(uint32_t), str.c_str(), buff_len);
 }
 
 void Session::RecvString(std::string* str)
 {
 	uint32_t buff_len;
 
-	RecvUint32(&buff_len);
+	if (heldLength >= 0)
+	{
+		// Header read & tokens paid before the session was parked
+		buff_len = static_cast<uint32_t>(heldLength);
+		heldLength = -1;
+	}
+	else
+	{
+		// Reading the header clears it
+		const bool canPark = parkable;
+
+		RecvUint32(&buff_len);
+
+		// The stream cannot be resynchronized without reading the payload, end the session
+		if (buff_len > MAX_STRING_SIZE)
+		{
+			shutdown(fd, SHUT_RDWR);
+			throw std::runtime_error("String of " + std::to_string(buff_len) + " bytes is over the limit");
+		}
+
+		int64_t wait = Throttle(RateLimiter::Bucket::Messages, 1);
+
+		if (wait >= 0)
+		{
+			const int64_t bytesWait = Throttle(RateLimiter::Bucket::Bytes, buff_len + sizeof(uint32_t));
+
+			// Refused on its size: the message token goes back, a client sending a few big messages still gets its small ones
+			if (bytesWait < 0)
+				limiter->Refund(peer.GetAddress(), RateLimiter::Bucket::Messages, 1);
+
+			wait = bytesWait < 0 ? -1 : std::max(wait, bytesWait);
+		}
+
+		// The payload is read anyway on reject to keep the stream in sync
+		if (wait < 0)
+		{
+			SkipData(buff_len);
+			throw Rejected("Rate limit exceeded, message rejected");
+		}
+
+		if (wait > 0 && canPark)
+		{
+			heldLength = buff_len;
+			throw Delayed(std::chrono::microseconds(wait));
+		}
+
+		// Not reading meanwhile pushes back on the client through TCP flow control
+		if (wait > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(wait));
+	}
 
 	str->clear();
-	str->resize(buff_len); // can throw std::bad_alloc if not enough memory
-	
-	// Receive the string
-	RecvData(str->data(), buff_len);
+
+	// Grown as the payload arrives, a forged length costs the peer as many bytes as us
+	while (str->size() < buff_len)
+	{
+		size_t received = str->size();
+		uint32_t chunk = static_cast<uint32_t>(std::min<size_t>(buff_len - received, std::max<size_t>(received, RECV_CHUNK)));
+
+		str->resize(received + chunk); // can throw std::bad_alloc if not enough memory
+		RecvData(str->data() + received, chunk);
+	}
 }
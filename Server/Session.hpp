@@ -3,17 +3,119 @@
 #include <string>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+
+#include "RateLimiter.hpp"
+#include "Endpoint.hpp"
+#include "Capture.hpp"
 
 namespace TCPMachine {
 
+	class BatchFlusher;
+	class OutboundWriter;
+
+	// Immutable framed message (uint32 length + payload), shared by all the sessions it is sent to
+	using SharedFrame = std::shared_ptr<const std::string>;
+
 	class Session {
 
 	public:
 
-		explicit Session(const int fd);
+		// A message over a Reject limit: it was read & dropped, the session keeps going
+		class Rejected : public std::runtime_error {
+
+		public:
+
+			explicit Rejected(const std::string& what) : std::runtime_error(what) {}
+		};
+
+		// Over a Delay limit before the handler received or sent anything: nothing is lost & the tokens are paid.
+		// The worker parks the session without blocking and runs its handler again from the start once wait is over
+		class Delayed : public std::runtime_error {
+
+		public:
+
+			explicit Delayed(std::chrono::microseconds wait) : std::runtime_error("Rate limited, parked"), wait(wait) {}
+
+			const std::chrono::microseconds wait;
+		};
+
+		// Longest string RecvString accepts, a longer length ends the session
+		// Keep it below the bytes burst of the limiter so a message always fits in the bucket
+		static constexpr uint32_t MAX_STRING_SIZE = 8 * 1024 * 1024;
+		// First read of a string payload, the buffer doubles from there as the bytes arrive
+		static constexpr uint32_t RECV_CHUNK = 64 * 1024;
+
+		// What to do with a frame when the outbound queue is full (slow client)
+		enum class OverflowPolicy {
+			// Drop the new frame
+			Drop,
+			// Shut down the session
+			Disconnect,
+			// Drop the queued frames not being sent yet, the batches of the handler are kept
+			CoalesceLatest
+		};
+
+		// Where the session is in its life, set by its worker
+		enum class State : uint8_t {
+			// Waiting for the connections bucket
+			Admitting,
+			// Handler running
+			Running,
+			// Over a Delay limit, waiting for its tokens without a worker
+			Parked,
+			// Handler done, being torn down
+			Closing
+		};
+
+		// Coalescing of the small writes of the handler into one send
+		// A batch is sent when it reaches maxBytes, before the session reads (end of an exchange),
+		// on Flush or once its first write waited budget (with a flusher), whichever comes first.
+		// A body of maxBytes or more is not copied: the batch goes first, then the body at once
+		struct Batching {
+			// Max wait of a write, 0 sends every write at once (no batching)
+			std::chrono::microseconds budget{ 0 };
+			// Sent at once from this size
+			uint32_t maxBytes = 16 * 1024;
+		};
+
+		// Counters of the session, times are steady_clock ns
+		struct Stats {
+			State state;
+			uint64_t bytesIn;
+			uint64_t bytesOut;
+			int64_t startedAt;
+			int64_t lastActivity;
+			// Batches sent and the writes & bytes they held
+			uint64_t batches;
+			uint64_t batchedWrites;
+			uint64_t batchedBytes;
+		};
+
+		// peer as returned by accept, limiter can be nullptr for no limits
+		// acceptedAt: steady_clock ns of the accept, the age & the capture of the session start there
+		// capture: log of the received bytes, nullptr or not open to disable
+		// batching: Batching() sends every write at once
+		explicit Session(const int fd, const Endpoint& peer, int64_t acceptedAt, RateLimiter* limiter, CaptureLog* capture, const Batching& batching);
 		~Session();
 
+		// Take a token from the connections bucket of the client
+		// Return 0 if admitted, the nb of us to wait before running it (Delay) or -1 if refused
+		int64_t Admit();
+		// Worker only: the handler starts, or starts again after being parked
+		// Until it receives or sends, a Delay limit throws Delayed instead of blocking the worker
+		void Start();
+		// Worker only, before the handler writes: id of the session in the registry the flusher & the writer
+		// look it up in, flusher sends the batches past their budget (nullptr without a budget),
+		// writer sends the rest of the frames a full socket held back (nullptr: the next send does)
+		void Attach(uint64_t id, BatchFlusher* flusher, OutboundWriter* writer);
+
 		// Send a buffer using the current socket, throw std::runtime_error
+		// With batching it may only be queued, an error is then thrown by a later send, recv or Flush
 		void SendData(const char* buffer, uint32_t total_bytes);
 		// Receive a buffer using the current socket, throw std::runtime_error
 		void RecvData(char* buffer, uint32_t total_bytes);
@@ -31,22 +133,132 @@ namespace TCPMachine {
 		// Send a std::string, throw std::runtime_error
 		void SendString(const std::string& str);
 		// Recv a std::string, throw std::runtime_error, std::bad_alloc
+		// Count as a message for the rate limiter, throw Rejected once a rejected message is skipped
+		// or Delayed if the handler can be parked, the header is then kept for the next call
+		// Throw without reading the payload if the length is above MAX_STRING_SIZE
 		void RecvString(std::string* str);
 
 		// Send a bool, throw std::runtime_error
 		void SendBoolean(const bool value);
+
 		// Recv a bool, throw std::runtime_error
-		void RecvBoolean(bool* value);	
+		void RecvBoolean(bool* value);
+
+		// Queue a frame and try to send it without blocking, safe from any thread.
+		// The rest is sent by the writer once the socket is writable, else by the next Send* or Enqueue.
+		// maxQueued & policy only apply to the enqueued frames, the batches of the handler are never dropped.
+		// Return false if the frame was not queued (Drop & Disconnect on a full queue)
+		bool Enqueue(const SharedFrame& frame, size_t maxQueued, OverflowPolicy policy);
+		// Send the queued frames without blocking, safe from any thread (the writer calls it)
+		void SendQueued();
+
+		// IP:PORT of the client session, use Endpoint::Format to get it as text
+		const Endpoint& GetEndpoint() const;
 
-		const std::string& GetIpAddress() const;
+		// Safe from any thread, the counters are read without locking
+		Stats GetStats() const;
+		void SetState(State state);
+
+		// Shut the socket down from any thread, the worker sees the error on its next recv/send
+		void Shutdown();
+
+		// Send the current batch & the queued frames, throw std::runtime_error
+		// Call it when the handler is done writing, recv calls it on its own
+		void Flush();
+		// Send the batch without blocking if its budget expired at now (steady_clock ns)
+		// Called by the flusher of the SessionManager, safe from any thread. If the socket is in use
+		// it is scheduled again a quarter of the budget later, if it is full the writer sends the rest
+		void FlushExpired(int64_t now);
 
 	private:
 
-		const int fd; 
+		// ================== Hot: every recv of the worker ==================
+		// One cache line, only written by the worker, the admin only reads it
+		alignas(64) const int fd;
+		std::atomic<State> state;
+		// Nothing received or sent since Start, a Delay limit can park the session
+		bool parkable;
+		RateLimiter* limiter;
+		std::atomic<uint64_t> bytesIn;
+		// steady_clock ns of the last recv (coarse)
+		std::atomic<int64_t> lastRecv;
+		// Length of the string whose header was read & paid before parking, -1 if none
+		int64_t heldLength;
+
+		// ================== Shared with the publishers ==================
+		// Own cache lines so a publisher queuing a frame does not invalidate the hot line
+		// Written by whoever sends: the worker, TryFlush of the publishers & the flusher
+		alignas(64) std::atomic<uint64_t> bytesOut;
+		// steady_clock ns of the last send (coarse)
+		std::atomic<int64_t> lastSend;
+		std::atomic<uint64_t> batches;
+		std::atomic<uint64_t> batchedWrites;
+		std::atomic<uint64_t> batchedBytes;
 
+		// Held while writing to the socket so frames are never interleaved
+		std::mutex guardSend;
+		// Protect outbound & outboundOffset
+		std::mutex guardOutbound;
+		struct Queued {
+			SharedFrame frame;
+			// A batch of the handler: not counted in maxQueued, never coalesced
+			bool own;
+		};
+
+		// Frames waiting to be sent, only the guardSend holder pops them
+		std::deque<Queued> outbound;
+		// Nb of frames of outbound queued by Enqueue
+		size_t nbOfEnqueued;
+		// Bytes of the first frame already sent
+		size_t outboundOffset;
+		// Nb of frames at the front being sent, CoalesceLatest keeps them
+		size_t outboundInFlight;
+
+		// Writes of the handler not sent yet (guardSend)
+		std::string batch;
+		// steady_clock ns when the batch must be sent, 0 if nothing is waiting
+		std::atomic<int64_t> batchDeadline;
+		const Batching batching;
+
+		// ================== Cold: set once or rarely used ==================
 		// IP:PORT of the client session
-		std::string fullIp;
+		alignas(64) const Endpoint peer;
+		const int64_t startedAt;
+		// Everything received, when the capture is on
+		CaptureBuffer capture;
+		// Told when a batch starts, nullptr if only the worker sends the batches
+		BatchFlusher* flusher;
+		// Told when the socket is full, nullptr if the next send finishes the frames
+		OutboundWriter* writer;
+		uint64_t id;
+
+		// steady_clock ns
+		static int64_t Now();
+		// Same clock at tick resolution (1-4 ms) without the cost of a precise read, for the activity stamps
+		static int64_t CoarseNow();
+		// Count bytes sent or received and mark the session active
+		void Count(std::atomic<uint64_t>& counter, std::atomic<int64_t>& last, size_t bytes);
+
+		// Most frames sent by one sendmsg
+		static constexpr size_t MAX_IOV = 64;
+
+		// Write the whole buffer, guardSend held, throw std::runtime_error
+		void WriteAll(const char* buffer, uint32_t total_bytes);
+		// Send head & body in order, batched or at once, throw std::runtime_error
+		void Write(const char* head, uint32_t headBytes, const char* body, uint32_t bodyBytes);
+		// Queue the batch as an own frame, guardSend held
+		void Seal();
+		// Send the queued frames, coalesced by sendmsg, guardSend held. Blocking: throw std::runtime_error
+		// Non blocking: return false if the socket is full (watched by the writer) or failed, true once the queue is empty
+		bool FlushOutbound(bool blocking);
+		// Flush if nobody is writing, the writer re-checks the queue after releasing guardSend
+		void TryFlush();
+
+		// Take the tokens: 0 if allowed, the nb of us to wait on Delay or -1 on Reject
+		// Throw std::runtime_error on Disconnect
+		int64_t Throttle(RateLimiter::Bucket bucket, uint32_t cost);
 
-		void SetIpAddress();
+		// Read and drop total_bytes, throw std::runtime_error
+		void SkipData(uint32_t total_bytes);
 	};
 }
\ No newline at end of file
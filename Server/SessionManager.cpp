@@ -2,15 +2,53 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
 
 #include "Session.hpp"
 
 using namespace TCPMachine;
 
-SessionManager::SessionManager(uint8_t nbOfThreads) : threadPool(), queue()
+namespace {
+
+	// steady_clock ns
+	int64_t NowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Default handler: one string from the client, one reply
+	void Demo(Session& bot)
+	{
+		std::string message;
+
+		bot.RecvString(&message);
+		std::cout << "Message from client: " << message << std::endl;
+
+		bot.SendString("Hello from Server !");
+	}
+}
+
+SessionManager::SessionManager(size_t nbOfThreads, RateLimiter* limiter, Broadcaster* broadcaster, CaptureLog* capture, SessionRegistry* registry) : topology(), batching(), handler(Demo), workerOfCpu(), slab(MAX_SESSIONS), workers(), threadPool(), flusher(registry), writer(registry), queue()
 {
 	this->nbOfThreads = nbOfThreads;
+	this->limiter = limiter;
+	this->broadcaster = broadcaster;
+	this->capture = capture;
+	this->registry = registry;
+
+	// An fd is always below the soft limit of open files
+	struct rlimit limit {};
+	if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY)
+		limit.rlim_cur = 1024;
+
+	// Capped, fds above fall back to getpeername()
+	this->nbOfAccepted = std::min<size_t>(limit.rlim_cur, 1 << 20);
+	this->accepted.reset(new Accepted[nbOfAccepted]);
+	this->nbOfReady = 0;
+	this->pending.store(0);
 	this->areRunning.store(false);
 }
 
@@ -22,26 +60,281 @@ SessionManager::~SessionManager()
 	}
 }
 
+int SessionManager::SetTopology(const Topology& topology)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (areRunning.load())
+	{
+		std::cerr << "[MANAGER] : Topology must be set before the workers start !" << std::endl;
+		return -1;
+	}
+
+	this->topology = topology;
+	return 0;
+}
+
+int SessionManager::SetBatching(const Session::Batching& batching)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (areRunning.load())
+	{
+		std::cerr << "[MANAGER] : Batching must be set before the workers start !" << std::endl;
+		return -1;
+	}
+
+	this->batching = batching;
+	return 0;
+}
+
+int SessionManager::SetHandler(Handler handler)
+{
+	std::unique_lock<std::mutex> lock(guardStartStop);
+
+	if (areRunning.load() || not handler)
+	{
+		std::cerr << "[MANAGER] : Handler must be set before the workers start !" << std::endl;
+		return -1;
+	}
+
+	this->handler = std::move(handler);
+	return 0;
+}
+
 void SessionManager::Push(const int socket)
 {
-	std::unique_lock<std::mutex> lock(guardQueue);
+	Push(socket, Endpoint::FromSocket(socket));
+}
 
-	queue.push(socket);
+void SessionManager::Push(const int socket, const Endpoint& peer, int incomingCpu)
+{
+	// Read by the worker after Get, the queue lock orders the write before it
+	if (static_cast<size_t>(socket) < nbOfAccepted)
+		accepted[socket] = { peer, NowNs(), 0 };
+
+	// Only mapped while the workers run, Push is called by the listener that started them
+	int worker = incomingCpu >= 0 && static_cast<size_t>(incomingCpu) < workerOfCpu.size() ? workerOfCpu[incomingCpu] : -1;
+
+	{
+		std::unique_lock<std::mutex> lock(guardQueue);
+
+		if (worker >= 0)
+			workers[worker]->inbox.push(socket);
+		else
+			queue.push(socket);
+
+		pending++;
+	}
+
+	// The owner of the inbox must wake up, not any worker
+	if (worker >= 0)
+		wakeWorkers.notify_all();
+	else
+		wakeWorkers.notify_one();
 }
 
-int SessionManager::Get()
+int SessionManager::Get(size_t index)
+{
+	int fd = -1;
+
+	// ================== Own deque first ==================
+	// Oldest first (top, like the thieves) so a socket does not wait behind every newer one.
+	// A steal can lose against a thief, retry while the deque is not empty
+	WorkStealingDeque<int>& deque = workers[index]->deque;
+
+	while (deque.Size() > 0)
+	{
+		if (deque.Steal(&fd))
+			return fd;
+	}
+
+	// ================== Then the inbox & the inject queue ==================
+	fd = GetFromQueue(index);
+	if (fd >= 0)
+		return fd;
+
+	// ================== Then steal from a busy worker ==================
+	// Start after our own index so the thieves do not all hit the same victim
+	for (size_t i = 1; i < workers.size(); i++)
+	{
+		if (workers[(index + i) % workers.size()]->deque.Steal(&fd))
+			return fd;
+	}
+
+	return -1;
+}
+
+int SessionManager::GetFromQueue(size_t index)
 {
 	std::unique_lock<std::mutex> lock(guardQueue);
 
+	// Parked sessions due first, they already waited for their tokens
+	int fd = GetParked();
+	if (fd >= 0)
+		return fd;
+
+	// Routed to us, one at a time so they stay in the inbox & on our CPU
+	std::queue<int>* inbox = &workers[index]->inbox;
+
+	// A busy worker cannot serve its inbox, help it once the inject queue is empty
+	for (size_t i = 1; i < workers.size() && inbox->empty() && queue.empty(); i++)
+	{
+		Worker& other = *workers[(index + i) % workers.size()];
+
+		if (other.busy.load() && not other.inbox.empty())
+			inbox = &other.inbox;
+	}
+
+	if (not inbox->empty())
+	{
+		fd = inbox->front();
+		inbox->pop();
+		return fd;
+	}
+
 	if (queue.empty())
 		return -1;
 
-	int fd = queue.front();
+	// Take a fair share, the rest of the batch can be stolen by the idle workers
+	size_t batch = std::max<size_t>(1, queue.size() / workers.size());
+
+	fd = queue.front();
 	queue.pop();
 
+	for (size_t i = 1; i < batch; i++)
+	{
+		workers[index]->deque.Push(queue.front());
+		queue.pop();
+	}
+
+	// Pushed under the queue lock so no idle worker misses the wake up
+	if (batch > 1)
+		wakeWorkers.notify_all();
+
 	return fd;
 }
 
+bool SessionManager::Acquire(const int fd)
+{
+	std::unique_lock<std::mutex> lock(guardActive);
+
+	// Checked under the active lock so no socket becomes active once StopWorkers started
+	if (not areRunning.load())
+		return false;
+
+	active.insert(fd);
+	return true;
+}
+
+void SessionManager::Release(const int fd)
+{
+	std::unique_lock<std::mutex> lock(guardActive);
+
+	active.erase(fd);
+	pending--;
+}
+
+bool SessionManager::Stealable(size_t index) const
+{
+	if (not workers[index]->inbox.empty())
+		return true;
+
+	for (const auto& worker : workers)
+	{
+		if (worker->deque.Size() > 0 || (worker->busy.load() && not worker->inbox.empty()))
+			return true;
+	}
+
+	return false;
+}
+
+void SessionManager::MapCpus()
+{
+	workerOfCpu.clear();
+
+	if (not topology.followIncomingCpu || topology.workerCpus.empty())
+		return;
+
+	int maxCpu = -1;
+	for (int cpu : topology.workerCpus)
+		maxCpu = std::max(maxCpu, cpu);
+
+	workerOfCpu.assign(static_cast<size_t>(maxCpu) + 1, -1);
+
+	// The first worker pinned on a CPU gets the sockets arriving on it
+	for (size_t i = 0; i < nbOfThreads && i < topology.workerCpus.size(); i++)
+	{
+		int cpu = topology.workerCpus[i];
+
+		if (cpu >= 0 && workerOfCpu[cpu] < 0)
+			workerOfCpu[cpu] = static_cast<int>(i);
+	}
+
+	// A CPU without a worker (e.g. the listener's) uses one on its node to keep the memory local
+	for (size_t cpu = 0; cpu < workerOfCpu.size(); cpu++)
+	{
+		if (workerOfCpu[cpu] >= 0)
+			continue;
+
+		int node = Topologies::GetNode(static_cast<int>(cpu));
+
+		for (size_t i = 0; i < nbOfThreads && i < topology.workerCpus.size(); i++)
+		{
+			if (Topologies::GetNode(topology.workerCpus[i]) == node)
+			{
+				workerOfCpu[cpu] = static_cast<int>(i);
+				break;
+			}
+		}
+	}
+}
+
+size_t SessionManager::Pending()
+{
+	return pending.load();
+}
+
+std::vector<int> SessionManager::TakeQueued()
+{
+	std::vector<int> fds;
+
+	{
+		std::unique_lock<std::mutex> lock(guardQueue);
+
+		while (not queue.empty())
+		{
+			fds.push_back(queue.front());
+			queue.pop();
+		}
+
+		for (auto& worker : workers)
+		{
+			while (not worker->inbox.empty())
+			{
+				fds.push_back(worker->inbox.front());
+				worker->inbox.pop();
+			}
+		}
+	}
+
+	// A steal can lose against the owner, retry while the deque is not empty
+	for (auto& worker : workers)
+	{
+		int fd = -1;
+
+		while (worker->deque.Size() > 0)
+		{
+			if (worker->deque.Steal(&fd))
+				fds.push_back(fd);
+		}
+	}
+
+	pending -= fds.size();
+
+	return fds;
+}
+
 int SessionManager::StartWorkers()
 {
 	std::unique_lock<std::mutex> lock(guardStartStop);
@@ -57,10 +350,23 @@ int SessionManager::StartWorkers()
 
 	areRunning.store(true);
 
-	for (int i{ 0 }; i < nbOfThreads; i++)
+	MapCpus();
+	workers.resize(nbOfThreads);
+	nbOfReady = 0;
+
+	for (size_t i{ 0 }; i < nbOfThreads; i++)
 	{
-		threadPool.push_back(std::thread(&SessionManager::WorkerThread, this));
+		threadPool.emplace_back(&SessionManager::WorkerThread, this, i);
 	}
+
+	if (batching.budget.count() > 0)
+		flusher.Start();
+
+	writer.Start();
+
+	// All the deques exist before a socket is routed to an inbox or a worker starts to steal
+	std::unique_lock<std::mutex> lockQueue(guardQueue);
+	wakeWorkers.wait(lockQueue, [this]() { return nbOfReady == workers.size(); });
 	
 	return 0;
 }
@@ -77,64 +383,302 @@ int SessionManager::StopWorkers()
 
 	// ======================================================
 	std::cerr << "[MANAGER] : Stopping Worker Threads ..." << std::endl;
-	areRunning.store(false);
-	for (auto& th : threadPool)
 	{
-		if (th.joinable())
-			th.join();
+		std::unique_lock<std::mutex> lockActive(guardActive);
+		areRunning.store(false);
+
+		// Unblock the workers still waiting on a client so they can be joined
+		for (int fd : active)
+			shutdown(fd, SHUT_RDWR);
+	}
+
+	{
+		std::unique_lock<std::mutex> lockQueue(guardQueue);
+		wakeWorkers.notify_all();
 	}
+
+	for (auto& thread : threadPool)
+	{
+		if (thread.joinable())
+			thread.join();
+	}
+
+	flusher.Stop();
+	writer.Stop();
 	std::cerr << "[MANAGER] : Threads Stopped !" << std::endl;
 
 	// ======================================================
 	std::cerr << "[MANAGER] : Closing Sockets in Queue ..." << std::endl;
-	std::unique_lock<std::mutex> lockB(guardQueue);
-	while (not queue.empty())
+	for (int fd : TakeQueued())
 	{
-		int fd = queue.front();
-		queue.pop();
 		close(fd);
 	}
+
+	// No worker left to resume them
+	while (not parked.empty())
+	{
+		Discard(parked.top().second);
+		parked.pop();
+		pending--;
+	}
+	workers.clear();
+	workerOfCpu.clear();
+	threadPool.clear();
 	std::cerr << "[MANAGER] : All Sockets are Closed ..." << std::endl;
 
 	return 0;
 }
 
-void SessionManager::WorkerThread()
+int SessionManager::DrainWorkers(std::chrono::milliseconds deadline)
+{
+	if (not areRunning.load())
+	{
+		std::cerr << "[MANAGER] : Worker Threads are Not Running !" << std::endl;
+		return -1;
+	}
+
+	// ======================================================
+	std::cerr << "[MANAGER] : Draining Sessions ..." << std::endl;
+	const auto end = std::chrono::steady_clock::now() + deadline;
+	size_t pending = Pending();
+
+	while (pending > 0 && std::chrono::steady_clock::now() < end)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		pending = Pending();
+	}
+
+	if (pending > 0)
+		std::cerr << "[MANAGER] : Drain Deadline Reached, " << pending << " Sessions Left !" << std::endl;
+	else
+		std::cerr << "[MANAGER] : All Sessions Drained !" << std::endl;
+
+	return StopWorkers();
+}
+
+void SessionManager::WorkerThread(size_t index)
 {
+	// ================== Pin then allocate ==================
+	// First touch: the deque & the stack of the sessions come from the node of the CPU
+	if (not topology.workerCpus.empty())
+		Topologies::PinCurrentThread({ topology.workerCpus[index % topology.workerCpus.size()] });
+
+	{
+		std::unique_ptr<Worker> worker = std::make_unique<Worker>();
+		std::unique_lock<std::mutex> lock(guardQueue);
+
+		workers[index] = std::move(worker);
+		nbOfReady++;
+		wakeWorkers.notify_all();
+
+		// The other deques may be stolen from once they all exist
+		wakeWorkers.wait(lock, [this]() { return nbOfReady == workers.size(); });
+	}
+
 	std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Worker Thread Started" << std::endl;
 
-	// Take a socket from the queue and process it
+	// Take a socket from the queues and process it
 	while (areRunning.load())
 	{
-		int fd = Get();
+		int fd = Get(index);
 
 		if (fd < 0)
 		{
-			// No socket to use sleeping ...
-			std::this_thread::sleep_for(std::chrono::seconds(1));
+			// No socket to use sleeping until one is pushed, a batch can be stolen or a parked session is due.
+			// No predicate: a session parked meanwhile changes the due time, Get checks again on any wake up
+			std::unique_lock<std::mutex> lock(guardQueue);
+			auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+
+			if (not parked.empty())
+				until = std::min(until, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(parked.top().first)));
+
+			if (queue.empty() && not Stealable(index) && areRunning.load() && (parked.empty() || parked.top().first > NowNs()))
+				wakeWorkers.wait_until(lock, until);
+
 			continue;
 		}
+
+		if (not Acquire(fd))
+		{
+			// Stopping, the socket is no longer in a queue for StopWorkers to close it
+			Discard(fd);
+			pending--;
+			break;
+		}
 		
-		Session bot = Session(fd);
-		std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Connected to: " << bot.GetIpAddress() << std::endl;
+		// Our inbox is shared with the idle workers until the session ends
+		workers[index]->busy.store(true);
+		HandleSession(fd);
+		workers[index]->busy.store(false);
+	}
+
+	std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Worker Thread Stopped" << std::endl;
+}
+
+void SessionManager::HandleSession(const int fd)
+{
+	// ================== Resume the parked session or create one ==================
+	uint64_t id = static_cast<size_t>(fd) < nbOfAccepted ? accepted[fd].parked : 0;
+	const bool resumed = id != 0;
+
+	if (resumed)
+		accepted[fd].parked = 0;
+	else
+	{
+		// Above the table the time it waited in the queues is unknown, it starts now
+		const Accepted from = static_cast<size_t>(fd) < nbOfAccepted ? accepted[fd] : Accepted{ Endpoint::FromSocket(fd), NowNs(), 0 };
+		id = slab.Create(fd, from.peer, from.at, limiter, capture, batching);
+
+		if (id == Slab<Session>::INVALID)
+		{
+			std::cerr << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : No free session slot" << std::endl;
+			Release(fd);
+			close(fd);
+			return;
+		}
+
+		registry->Register(id, slab.Get(id));
+
+		slab.Get(id)->Attach(id, batching.budget.count() > 0 ? &flusher : nullptr, &writer);
+	}
+
+	Session& bot = *slab.Get(id);
+
+	// Formatted once on the stack for the logs below
+	char ip[Endpoint::FORMAT_MAX];
+	bot.GetEndpoint().Format(ip, sizeof(ip));
+
+	if (resumed)
+		std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Resumed: " << ip << " (session " << id << ")" << std::endl;
+	else
+	{
+		// Over the connections/sec of the client, drop it or park it before running the handler
+		const int64_t wait = bot.Admit();
+
+		if (wait < 0)
+		{
+			std::cerr << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Rate limited, refusing: " << ip << std::endl;
+			registry->Unregister(id);
+			Release(fd);
+			slab.Destroy(id);
+			return;
+		}
+
+		if (wait > 0 && Park(fd, id, std::chrono::microseconds(wait)))
+			return;
+
+		// Above the table of the parked sockets, wait on the worker
+		if (wait > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(wait));
+
+		std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Connected to: " << ip << " (session " << id << ")" << std::endl;
+	}
+
+	while (true)
+	{
+		bot.Start();
+		// Does nothing if it already is, a session parked while admitted is not yet
+		broadcaster->Subscribe(Broadcaster::ALL, &bot);
 
 		try
 		{
-			std::string message;
-			bot.RecvString(&message);
+			try
+			{
+				handler(bot);
+			}
+			catch (const Session::Rejected& e)
+			{
+				// The message was dropped but the session goes on, tell the client
+				std::cerr << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : " << e.what() << ": " << ip << std::endl;
+				bot.SendString("Rejected, retry later");
+			}
 
-			std::cout << "Message from client: " << message << std::endl;
+			// Done writing, send what is batched
+			bot.Flush();
+		}
+		catch (const Session::Delayed& e)
+		{
+			// Nothing was read nor sent, the handler runs again from the start once the tokens are there
+			if (Park(fd, id, e.wait))
+				return;
 
-			bot.SendString("Hello from Server !");
+			std::this_thread::sleep_for(e.wait);
+			continue;
 		}
 		catch (const std::exception& e)
 		{
 			std::cerr << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : " << e.what() << std::endl;
 		}
 
-		// When the session goes out of scope the dtor will close the socket
-		std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Disconnecting: " << bot.GetIpAddress() << std::endl;
+		break;
 	}
 
-	std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Worker Thread Stopped" << std::endl;
-}
\ No newline at end of file
+	bot.SetState(Session::State::Closing);
+
+	// No publisher nor admin may use the session once it is destroyed
+	broadcaster->UnsubscribeAll(&bot);
+	registry->Unregister(id);
+
+	// Leave the active set before the dtor closes the socket, the fd number could be reused right after
+	Release(fd);
+
+	std::cout << "[MANAGER] [THREAD: 0x" << std::this_thread::get_id() << "] : Disconnecting: " << ip << std::endl;
+
+	// The dtor closes the socket & the slot goes back to the slab
+	slab.Destroy(id);
+}
+
+bool SessionManager::Park(const int fd, uint64_t id, std::chrono::microseconds wait)
+{
+	// Found again by its fd when due
+	if (static_cast<size_t>(fd) >= nbOfAccepted)
+		return false;
+
+	slab.Get(id)->SetState(Session::State::Parked);
+
+	// Not active while parked, still pending so a drain waits for it
+	{
+		std::unique_lock<std::mutex> lock(guardActive);
+		active.erase(fd);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(guardQueue);
+		accepted[fd].parked = id;
+		parked.emplace(NowNs() + std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count(), fd);
+	}
+
+	// An idle worker sleeping past the new due time computes its wait again
+	wakeWorkers.notify_one();
+	return true;
+}
+
+int SessionManager::GetParked()
+{
+	if (parked.empty() || parked.top().first > NowNs())
+		return -1;
+
+	int fd = parked.top().second;
+	parked.pop();
+	return fd;
+}
+
+void SessionManager::Discard(const int fd)
+{
+	const uint64_t id = static_cast<size_t>(fd) < nbOfAccepted ? accepted[fd].parked : 0;
+
+	if (id == 0)
+	{
+		close(fd);
+		return;
+	}
+
+	accepted[fd].parked = 0;
+
+	Session* bot = slab.Get(id);
+	broadcaster->UnsubscribeAll(bot);
+	registry->Unregister(id);
+
+	// The dtor closes the socket
+	slab.Destroy(id);
+}
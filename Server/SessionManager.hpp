@@ -5,46 +5,186 @@
 #include <vector>
 #include <queue>
 #include <thread>
+#include <chrono>
+#include <memory>
+#include <condition_variable>
+#include <functional>
+#include <utility>
+#include <unordered_set>
+
+#include "WorkStealingDeque.hpp"
+#include "Slab.hpp"
+#include "RateLimiter.hpp"
+#include "Endpoint.hpp"
+#include "Broadcaster.hpp"
+#include "Capture.hpp"
+#include "Topology.hpp"
+#include "SessionRegistry.hpp"
+#include "BatchFlusher.hpp"
+#include "OutboundWriter.hpp"
 
 namespace TCPMachine {
 
 	// Start a Session in a Thread
+	// A session is a task run from start to end by one worker so its messages stay ordered.
+	// The listener pushes sockets to a shared inject queue, workers move them by batch
+	// to their own deque and idle workers steal from the deques of the busy ones.
+	// Sessions are built in a slab of cache aligned slots, their handle is their id.
+	// With a Topology the workers are pinned and allocate their deque from their own CPU,
+	// sockets pushed with their incoming CPU go to the inbox of the worker on that CPU.
+	// A session over a Delay limit is parked instead of sleeping on its worker,
+	// a worker resumes it once its tokens are there.
 	class SessionManager {
 
 	public:
 
-		explicit SessionManager(uint8_t nbOfThreads);
+		// Sessions alive at once at most, the slab only touches the pages of the slots used
+		static constexpr size_t MAX_SESSIONS = 100000;
+
+		// Runs one exchange on the session, the manager handles Rejected, Delayed & the errors it throws
+		using Handler = std::function<void(Session& session)>;
+
+		// limiter is shared by all the sessions, can be nullptr for no limits
+		// broadcaster: every session is subscribed to Broadcaster::ALL while it runs
+		// capture: log of what the sessions receive, recorded only while open
+		// registry: every session is registered while it runs
+		explicit SessionManager(size_t nbOfThreads, RateLimiter* limiter, Broadcaster* broadcaster, CaptureLog* capture, SessionRegistry* registry);
 		~SessionManager();
 
+		// Call before StartWorkers: CPUs of the workers, not pinned by default
+		int SetTopology(const Topology& topology);
+		// Call before StartWorkers: batching of the writes of every session, off by default
+		// With a budget a BatchFlusher sends the batches that waited too long
+		int SetBatching(const Session::Batching& batching);
+		// Call before StartWorkers: what the sessions run, the demo (one string, one reply) by default
+		int SetHandler(Handler handler);
+
 		// Start the thread workers
 		int StartWorkers();
 		// Stop & Join all threads socket on the queue are closed.
 		int StopWorkers();
+		// Let queued & active sessions finish until the deadline, then stop the workers
+		// Sessions still active after the deadline are shut down.
+		int DrainWorkers(std::chrono::milliseconds deadline);
 
-		// Add the socket to the queue to be processed
+		// Remove and return all the sockets waiting in the queues (used for hot restart)
+		std::vector<int> TakeQueued();
+
+		// Add the socket to the queue to be processed, peer as returned by accept
+		// Called by the listener right after accept, the session starts at this time
+		// incomingCpu: CPU the packets of the socket arrive on (-1: any worker)
+		void Push(const int fd, const Endpoint& peer, int incomingCpu = -1);
+		// Same but ask the kernel for the peer (sockets from a hand off)
 		void Push(const int fd);
 
 	private:
 
-		uint8_t nbOfThreads;
+		// Allocated by its own thread once pinned so the pages are on its NUMA node
+		struct Worker {
+			// Sockets taken from the inject queue, stolen by the idle workers
+			WorkStealingDeque<int> deque;
+			// Sockets routed to this worker by their incoming CPU (guardQueue)
+			// Left to the owner while it is idle, shared with the others while it is busy
+			std::queue<int> inbox;
+			// True while the worker runs a session
+			std::atomic_bool busy{ false };
+		};
+
+		size_t nbOfThreads;
+
+		// Placement of the workers
+		Topology topology;
+		// Batching of the sessions
+		Session::Batching batching;
+		// Exchange run by every session
+		Handler handler;
+		// Worker index for each CPU: pinned on it or else on its node, -1 for none
+		std::vector<int> workerOfCpu;
+
+		// Per client limits checked by the sessions
+		RateLimiter* limiter;
+		// Topics the sessions subscribe to
+		Broadcaster* broadcaster;
+		// Record & replay of the sessions
+		CaptureLog* capture;
+		// Sessions listed & addressed by the admin
+		SessionRegistry* registry;
+
+		// What the listener knows of a socket when it accepts it
+		struct Accepted {
+			Endpoint peer;
+			// steady_clock ns
+			int64_t at;
+			// Session parked on the socket, 0 if none (guardQueue)
+			uint64_t parked;
+		};
+
+		// Accept of each queued socket indexed by fd, written by Push before the socket is queued.
+		// Sized on RLIMIT_NOFILE, the pages are only touched by the fds in use.
+		std::unique_ptr<Accepted[]> accepted;
+		size_t nbOfAccepted;
+
+		// A session lives in its slot while a worker runs it, sized for MAX_SESSIONS
+		Slab<Session> slab;
 
 		// Mutex to prevent writing to session queue at the same time
 		std::mutex guardQueue;
 		// Mutex to prevent starting while waiting stop to terminate.
 		std::mutex guardStartStop;
+		// Wake up the idle workers when a socket is pushed
+		std::condition_variable wakeWorkers;
 
-		// key: FD, val: thread  
+		// One deque per worker, created by the worker threads
+		std::vector<std::unique_ptr<Worker>> workers;
+		// Nb of workers created, StartWorkers returns once all of them are (guardQueue)
+		size_t nbOfReady;
+		// Worker threads
 		std::vector<std::thread> threadPool;
-		// Store key of the terminated threads
+		// Sends the expired batches, only started with a batching budget
+		BatchFlusher flusher;
+		// Sends the rest of the frames the full sockets held back
+		OutboundWriter writer;
+		// Inject queue filled by the listener
 		std::queue<int> queue;
+		// Sockets of the parked sessions by the steady_clock ns they are due, earliest on top (guardQueue)
+		std::priority_queue<std::pair<int64_t, int>, std::vector<std::pair<int64_t, int>>, std::greater<std::pair<int64_t, int>>> parked;
+
+		// Mutex to protect the set of sockets being processed by a worker
+		std::mutex guardActive;
+		// Sockets currently processed by a worker
+		std::unordered_set<int> active;
+		// Nb of sockets queued, in a deque or active
+		std::atomic_size_t pending;
 
 		// atomic bool to stop all threads
 		std::atomic_bool areRunning;
 
 		// Handler thread will create an run a session
-		void WorkerThread();		
+		void WorkerThread(size_t index);
+		// Run the session of the socket taken from the queue
+		void HandleSession(const int fd);
+
+		// Give the worker back while the session waits for its tokens (Delay), a worker resumes it once due
+		// False if it cannot be parked (fd above the table), the caller then waits on the worker
+		bool Park(const int fd, uint64_t id, std::chrono::microseconds wait);
+		// Take a parked socket that is due, -1 if none (guardQueue)
+		int GetParked();
+		// Close a socket that will not run, destroying the session parked on it
+		void Discard(const int fd);
 
-		// Take a socket from the queue to process
-		int Get();
+		// Take a socket from the own deque, the inject queue or another worker, -1 if none
+		int Get(size_t index);
+		// Move a batch of sockets from the inject queue to the deque, return one of them or -1
+		int GetFromQueue(size_t index);
+		// True if the worker has a socket in its inbox or can take one from another worker (guardQueue)
+		bool Stealable(size_t index) const;
+		// Map each CPU of the topology to a worker
+		void MapCpus();
+		// Mark the socket as active, false if the workers are stopping
+		bool Acquire(const int fd);
+		// Remove the socket from the active set once its session is over
+		void Release(const int fd);
+		// Nb of sockets queued or active
+		size_t Pending();
 	};
-}
\ No newline at end of file
+}
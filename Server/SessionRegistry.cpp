@@ -0,0 +1,207 @@
+#include "SessionRegistry.hpp"
+
+#include "Broadcaster.hpp"
+
+using namespace TCPMachine;
+
+SessionRegistry::SessionRegistry(size_t maxQueued, Session::OverflowPolicy policy) : maxQueued(maxQueued), policy(policy)
+{
+	this->size.store(0);
+}
+
+void SessionRegistry::Register(uint64_t id, Session* session)
+{
+	std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+	entry->session = session;
+
+	Shard& shard = ShardOf(id);
+	{
+		std::unique_lock<std::mutex> lock(shard.guard);
+		shard.entries.emplace(id, std::move(entry));
+	}
+
+	size++;
+}
+
+void SessionRegistry::Unregister(uint64_t id)
+{
+	std::shared_ptr<Entry> entry;
+
+	Shard& shard = ShardOf(id);
+	{
+		std::unique_lock<std::mutex> lock(shard.guard);
+
+		auto it = shard.entries.find(id);
+
+		if (it == shard.entries.end())
+			return;
+
+		entry = std::move(it->second);
+		shard.entries.erase(it);
+	}
+
+	size--;
+
+	// Wait for an admin call still using the session, the next ones find nullptr
+	std::unique_lock<std::mutex> lock(entry->guard);
+	entry->session = nullptr;
+}
+
+std::vector<SessionRegistry::Info> SessionRegistry::List()
+{
+	std::vector<Info> infos;
+	infos.reserve(Size());
+
+	ForEach([&infos](uint64_t id, Session& session) {
+		infos.emplace_back();
+		Fill(id, session, &infos.back());
+	});
+
+	return infos;
+}
+
+void SessionRegistry::ForEach(const std::function<void(uint64_t id, Session& session)>& fn)
+{
+	for (Shard& shard : shards)
+	{
+		std::vector<std::pair<uint64_t, std::shared_ptr<Entry>>> entries;
+
+		// Copied so the shard is not locked while the sessions are read
+		{
+			std::unique_lock<std::mutex> lock(shard.guard);
+			entries.assign(shard.entries.begin(), shard.entries.end());
+		}
+
+		for (const auto& entry : entries)
+		{
+			std::unique_lock<std::mutex> lock(entry.second->guard);
+
+			if (entry.second->session == nullptr)
+				continue;
+
+			fn(entry.first, *entry.second->session);
+		}
+	}
+}
+
+bool SessionRegistry::Query(uint64_t id, Info* info)
+{
+	std::shared_ptr<Entry> entry = Find(id);
+
+	if (entry == nullptr)
+		return false;
+
+	std::unique_lock<std::mutex> lock(entry->guard);
+
+	if (entry->session == nullptr)
+		return false;
+
+	Fill(id, *entry->session, info);
+	return true;
+}
+
+bool SessionRegistry::Kill(uint64_t id)
+{
+	std::shared_ptr<Entry> entry = Find(id);
+
+	if (entry == nullptr)
+		return false;
+
+	// The socket cannot be closed (and its fd reused) while we hold the entry
+	std::unique_lock<std::mutex> lock(entry->guard);
+
+	if (entry->session == nullptr)
+		return false;
+
+	entry->session->Shutdown();
+	return true;
+}
+
+bool SessionRegistry::SendTo(uint64_t id, const std::string& payload)
+{
+	std::shared_ptr<Entry> entry = Find(id);
+
+	if (entry == nullptr)
+		return false;
+
+	SharedFrame frame = Broadcaster::Frame(payload);
+
+	std::unique_lock<std::mutex> lock(entry->guard);
+
+	if (entry->session == nullptr)
+		return false;
+
+	return entry->session->Enqueue(frame, maxQueued, policy);
+}
+
+bool SessionRegistry::FlushExpired(uint64_t id, int64_t now)
+{
+	std::shared_ptr<Entry> entry = Find(id);
+
+	if (entry == nullptr)
+		return false;
+
+	std::unique_lock<std::mutex> lock(entry->guard);
+
+	if (entry->session == nullptr)
+		return false;
+
+	entry->session->FlushExpired(now);
+	return true;
+}
+
+bool SessionRegistry::SendQueued(uint64_t id)
+{
+	std::shared_ptr<Entry> entry = Find(id);
+
+	if (entry == nullptr)
+		return false;
+
+	std::unique_lock<std::mutex> lock(entry->guard);
+
+	if (entry->session == nullptr)
+		return false;
+
+	entry->session->SendQueued();
+	return true;
+}
+
+size_t SessionRegistry::Size() const
+{
+	return size.load();
+}
+
+SessionRegistry::Shard& SessionRegistry::ShardOf(uint64_t id)
+{
+	return shards[(id * 0x9E3779B97F4A7C15ull) >> (64 - SHARD_BITS)];
+}
+
+std::shared_ptr<SessionRegistry::Entry> SessionRegistry::Find(uint64_t id)
+{
+	Shard& shard = ShardOf(id);
+	std::unique_lock<std::mutex> lock(shard.guard);
+
+	auto it = shard.entries.find(id);
+
+	if (it == shard.entries.end())
+		return nullptr;
+
+	return it->second;
+}
+
+void SessionRegistry::Fill(uint64_t id, const Session& session, Info* info)
+{
+	const Session::Stats stats = session.GetStats();
+	const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	info->id = id;
+	info->peer = session.GetEndpoint();
+	info->state = stats.state;
+	info->bytesIn = stats.bytesIn;
+	info->bytesOut = stats.bytesOut;
+	info->age = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(now - stats.startedAt));
+	info->idle = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(now - stats.lastActivity));
+	info->batches = stats.batches;
+	info->batchedWrites = stats.batchedWrites;
+	info->batchedBytes = stats.batchedBytes;
+}
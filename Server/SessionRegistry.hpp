@@ -0,0 +1,104 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <unordered_map>
+
+#include "Session.hpp"
+
+namespace TCPMachine {
+
+	// Sessions currently run by the workers, addressed by a session id for the admin.
+	// The sessions update their own counters with atomics, the registry is only touched
+	// when a session starts or ends and by the admin. The table is split in shards with
+	// one mutex each, an entry has its own lock so an admin call never races the teardown.
+	class SessionRegistry {
+
+	public:
+
+		// Snapshot of a session
+		struct Info {
+			uint64_t id = 0;
+			Endpoint peer;
+			Session::State state = Session::State::Admitting;
+			uint64_t bytesIn = 0;
+			uint64_t bytesOut = 0;
+			// Since the session started & since it last sent or received
+			std::chrono::milliseconds age{ 0 };
+			std::chrono::milliseconds idle{ 0 };
+			// Batches sent and the writes & bytes they held
+			uint64_t batches = 0;
+			uint64_t batchedWrites = 0;
+			uint64_t batchedBytes = 0;
+		};
+
+		// maxQueued & policy: outbound queue limit of the messages sent with SendTo
+		explicit SessionRegistry(size_t maxQueued = 64, Session::OverflowPolicy policy = Session::OverflowPolicy::Drop);
+
+		// id: handle of the session in the slab of the SessionManager (generation tagged)
+		// Unregister must be called before the session is destroyed
+		void Register(uint64_t id, Session* session);
+		void Unregister(uint64_t id);
+
+		// All the sessions registered when called, in no particular order
+		std::vector<Info> List();
+		// Call fn on every session registered when called, the session is not destroyed meanwhile
+		void ForEach(const std::function<void(uint64_t id, Session& session)>& fn);
+		// False if there is no session with this id
+		bool Query(uint64_t id, Info* info);
+		// Shut the socket down, the worker of the session sees the error on its next recv/send
+		// False if there is no session with this id
+		bool Kill(uint64_t id);
+		// Queue a message (framed like Session::SendString) on the session
+		// False if there is no session with this id or the message was not queued
+		bool SendTo(uint64_t id, const std::string& payload);
+		// Send the batch of the session if its budget expired at now (steady_clock ns), see Session::FlushExpired
+		// False if there is no session with this id
+		bool FlushExpired(uint64_t id, int64_t now);
+		// Send the queued frames of the session without blocking, see Session::SendQueued
+		// False if there is no session with this id
+		bool SendQueued(uint64_t id);
+
+		// Nb of sessions registered
+		size_t Size() const;
+
+	private:
+
+		struct Entry {
+			// Held while the session is used by the admin, Unregister takes it to wait for them
+			std::mutex guard;
+			// nullptr once unregistered
+			Session* session = nullptr;
+		};
+
+		// Padded so two workers using different shards do not share a cache line
+		struct alignas(64) Shard {
+			std::mutex guard;
+			std::unordered_map<uint64_t, std::shared_ptr<Entry>> entries;
+		};
+
+		// Power of 2, the shard of an id is the top bits of its Fibonacci hash
+		static constexpr unsigned SHARD_BITS = 6;
+		static constexpr size_t NB_OF_SHARDS = size_t(1) << SHARD_BITS;
+
+		const size_t maxQueued;
+		const Session::OverflowPolicy policy;
+
+		std::atomic_size_t size;
+		Shard shards[NB_OF_SHARDS];
+
+		// Mixes the slot & the generation of the id so the slots used together, or a slot
+		// & its next generations, do not stack on the same shards
+		Shard& ShardOf(uint64_t id);
+		// Entry of the session or nullptr, the shard lock is only held for the lookup
+		std::shared_ptr<Entry> Find(uint64_t id);
+		// Fill info from the session, entry lock held
+		static void Fill(uint64_t id, const Session& session, Info* info);
+	};
+}
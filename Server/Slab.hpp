@@ -0,0 +1,173 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <new>
+#include <sys/mman.h>
+
+namespace TCPMachine {
+
+	// Fixed number of objects reserved once, each on its own cache lines
+	// The slots are in an anonymous mapping: the pages of a slot are only touched once it is used,
+	// so a slab sized for every session the server may hold costs what the sessions alive use.
+	// An object is addressed by a handle: slot index (low 32 bits) & generation (high 32 bits).
+	// The generation is bumped when the object is destroyed so an old handle never
+	// reaches the next object of the slot. 0 is never a valid handle.
+	template <typename T>
+	class Slab {
+
+	public:
+
+		static constexpr uint64_t INVALID = 0;
+
+		// Throw std::bad_alloc if the address space cannot be reserved
+		explicit Slab(size_t capacity) : capacity(capacity), slots(nullptr), highWater(0)
+		{
+			void* addr = mmap(nullptr, capacity * sizeof(Slot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+			if (addr == MAP_FAILED)
+				throw std::bad_alloc();
+
+			slots = static_cast<Slot*>(addr);
+		}
+
+		~Slab()
+		{
+			const size_t used = highWater.load();
+
+			for (size_t i = 0; i < used; i++)
+			{
+				if (slots[i].used)
+					slots[i].Get()->~T();
+
+				slots[i].~Slot();
+			}
+
+			munmap(slots, capacity * sizeof(Slot));
+		}
+
+		Slab(const Slab&) = delete;
+		Slab& operator=(const Slab&) = delete;
+
+		// Construct an object in a free slot, return its handle or INVALID if the slab is full
+		template <typename... Args>
+		uint64_t Create(Args&&... args)
+		{
+			uint32_t index = 0;
+
+			{
+				std::unique_lock<std::mutex> lock(guard);
+
+				if (not free.empty())
+				{
+					index = free.back();
+					free.pop_back();
+				}
+				else if (highWater.load(std::memory_order_relaxed) < capacity)
+				{
+					// Never used: its pages are touched for the first time
+					index = static_cast<uint32_t>(highWater.load(std::memory_order_relaxed));
+					new (&slots[index]) Slot();
+					highWater.store(index + 1, std::memory_order_release);
+				}
+				else
+					return INVALID;
+			}
+
+			Slot& slot = slots[index];
+
+			try
+			{
+				new (slot.storage) T(std::forward<Args>(args)...);
+			}
+			catch (...)
+			{
+				std::unique_lock<std::mutex> lock(guard);
+				free.push_back(index);
+				throw;
+			}
+
+			slot.used = true;
+			return (static_cast<uint64_t>(slot.generation.load(std::memory_order_relaxed)) << 32) | index;
+		}
+
+		// Object of the handle, nullptr if it was destroyed
+		// For the owner of the handle, other threads must not keep the pointer
+		T* Get(uint64_t handle)
+		{
+			const uint32_t index = static_cast<uint32_t>(handle);
+
+			// Slots above were never constructed
+			if (index >= highWater.load(std::memory_order_acquire))
+				return nullptr;
+
+			Slot& slot = slots[index];
+
+			if (slot.generation.load(std::memory_order_acquire) != static_cast<uint32_t>(handle >> 32) || not slot.used)
+				return nullptr;
+
+			return slot.Get();
+		}
+
+		// Destroy the object of the handle & free its slot, does nothing for a stale handle
+		void Destroy(uint64_t handle)
+		{
+			T* object = Get(handle);
+
+			if (object == nullptr)
+				return;
+
+			const uint32_t index = static_cast<uint32_t>(handle);
+			Slot& slot = slots[index];
+
+			object->~T();
+			slot.used = false;
+
+			// Generation 0 is skipped so no handle is ever INVALID
+			uint32_t next = slot.generation.load(std::memory_order_relaxed) + 1;
+			slot.generation.store(next == 0 ? 1 : next, std::memory_order_release);
+
+			std::unique_lock<std::mutex> lock(guard);
+			free.push_back(index);
+		}
+
+		size_t Capacity() const
+		{
+			return capacity;
+		}
+
+		// Nb of slots ever used, their pages are resident
+		size_t HighWater() const
+		{
+			return highWater.load();
+		}
+
+	private:
+
+		// Padded to a multiple of the cache line so two slots never share one
+		struct alignas(64) Slot {
+			alignas(T) unsigned char storage[sizeof(T)];
+			// Starts at 1 so the handle of slot 0 is not INVALID
+			std::atomic<uint32_t> generation{ 1 };
+			// Owner of the handle only
+			bool used = false;
+
+			T* Get()
+			{
+				return std::launder(reinterpret_cast<T*>(storage));
+			}
+		};
+
+		const size_t capacity;
+		Slot* slots;
+		// Slots below are constructed, written under guard
+		std::atomic<size_t> highWater;
+
+		// Indexes of the slots freed, reused before a new one is touched
+		std::mutex guard;
+		std::vector<uint32_t> free;
+	};
+}
@@ -0,0 +1,128 @@
+#include "SocketProfile.hpp"
+
+#include <iostream>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace TCPMachine;
+
+namespace {
+
+	int SetOption(const int fd, int level, int name, int value, const char* label)
+	{
+		if (setsockopt(fd, level, name, &value, sizeof(value)) < 0)
+		{
+			std::cerr << "[SOCKET] : Could not set " << label << " to " << value << std::endl;
+			return -1;
+		}
+
+		return 0;
+	}
+}
+
+SocketOptions SocketProfiles::GetOptions(SocketProfile profile)
+{
+	SocketOptions options;
+
+	switch (profile)
+	{
+	case SocketProfile::LowLatency:
+		options.noDelay = true;
+		options.notSentLowat = 16 * 1024;
+		options.busyPoll = 50;
+		options.fastOpenQueue = 256;
+		// Clients always send first in our protocol, accept them with their first message
+		options.deferAccept = 1;
+		options.keepAlive = true;
+		options.keepIdle = 60;
+		options.keepInterval = 10;
+		options.keepCount = 5;
+		break;
+
+	case SocketProfile::BulkThroughput:
+		options.sendBuffer = 4 * 1024 * 1024;
+		options.recvBuffer = 4 * 1024 * 1024;
+		options.fastOpenQueue = 256;
+		options.keepAlive = true;
+		options.keepIdle = 60;
+		options.keepInterval = 10;
+		options.keepCount = 5;
+		break;
+
+	case SocketProfile::ManyIdle:
+		options.noDelay = true;
+		options.sendBuffer = 16 * 1024;
+		options.recvBuffer = 16 * 1024;
+		options.keepAlive = true;
+		options.keepIdle = 300;
+		options.keepInterval = 60;
+		options.keepCount = 4;
+		break;
+
+	default:
+		break;
+	}
+
+	return options;
+}
+
+const char* SocketProfiles::GetName(SocketProfile profile)
+{
+	switch (profile)
+	{
+	case SocketProfile::LowLatency:
+		return "LowLatency";
+	case SocketProfile::BulkThroughput:
+		return "BulkThroughput";
+	case SocketProfile::ManyIdle:
+		return "ManyIdle";
+	default:
+		return "Default";
+	}
+}
+
+int SocketProfiles::ApplyListener(const int fd, const SocketOptions& options)
+{
+	int result = 0;
+
+	if (options.sendBuffer > 0 && SetOption(fd, SOL_SOCKET, SO_SNDBUF, options.sendBuffer, "SO_SNDBUF") < 0)
+		result = -1;
+
+	if (options.recvBuffer > 0 && SetOption(fd, SOL_SOCKET, SO_RCVBUF, options.recvBuffer, "SO_RCVBUF") < 0)
+		result = -1;
+
+	if (options.fastOpenQueue > 0 && SetOption(fd, IPPROTO_TCP, TCP_FASTOPEN, options.fastOpenQueue, "TCP_FASTOPEN") < 0)
+		result = -1;
+
+	if (options.deferAccept > 0 && SetOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options.deferAccept, "TCP_DEFER_ACCEPT") < 0)
+		result = -1;
+
+	// ================== Options of the connections ==================
+	// Inherited by the accepted sockets, Linux clones them from the listener
+	if (options.noDelay && SetOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY") < 0)
+		result = -1;
+
+	if (options.notSentLowat > 0 && SetOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.notSentLowat, "TCP_NOTSENT_LOWAT") < 0)
+		result = -1;
+
+	if (options.busyPoll > 0 && SetOption(fd, SOL_SOCKET, SO_BUSY_POLL, options.busyPoll, "SO_BUSY_POLL") < 0)
+		result = -1;
+
+	if (options.keepAlive)
+	{
+		if (SetOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE") < 0)
+			result = -1;
+
+		if (options.keepIdle > 0 && SetOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, options.keepIdle, "TCP_KEEPIDLE") < 0)
+			result = -1;
+
+		if (options.keepInterval > 0 && SetOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, options.keepInterval, "TCP_KEEPINTVL") < 0)
+			result = -1;
+
+		if (options.keepCount > 0 && SetOption(fd, IPPROTO_TCP, TCP_KEEPCNT, options.keepCount, "TCP_KEEPCNT") < 0)
+			result = -1;
+	}
+
+	return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+namespace TCPMachine {
+
+	// Named sets of socket options for the listener & the accepted sockets
+	enum class SocketProfile {
+		// Kernel defaults, nothing is set
+		Default,
+		// Small request/response messages: no Nagle, busy poll, small unsent queue
+		LowLatency,
+		// Big transfers: Nagle on, large buffers
+		BulkThroughput,
+		// Lots of mostly idle bots: small buffers, keepalive to reap dead peers
+		ManyIdle
+	};
+
+	struct SocketOptions {
+		// TCP_NODELAY
+		bool noDelay = false;
+		// SO_SNDBUF / SO_RCVBUF in bytes, 0 keeps the kernel autotuning
+		int sendBuffer = 0;
+		int recvBuffer = 0;
+		// TCP_NOTSENT_LOWAT in bytes, 0 to leave unset
+		int notSentLowat = 0;
+		// SO_BUSY_POLL in microseconds, 0 to leave unset (may need CAP_NET_ADMIN)
+		int busyPoll = 0;
+		// TCP_FASTOPEN queue length on the listener, 0 to disable
+		int fastOpenQueue = 0;
+		// TCP_DEFER_ACCEPT in seconds, only for protocols where the client speaks first
+		int deferAccept = 0;
+		// SO_KEEPALIVE with TCP_KEEPIDLE / TCP_KEEPINTVL (seconds) & TCP_KEEPCNT
+		bool keepAlive = false;
+		int keepIdle = 0;
+		int keepInterval = 0;
+		int keepCount = 0;
+	};
+
+	namespace SocketProfiles {
+
+		SocketOptions GetOptions(SocketProfile profile);
+
+		const char* GetName(SocketProfile profile);
+
+		// Before bind/listen: buffers (so the window scale is right), fast open, defer accept
+		// and the connection options. The accepted sockets inherit all of them, nothing is set per connection.
+		// Log each option that failed, return -1 if one of them failed
+		int ApplyListener(const int fd, const SocketOptions& options);
+	}
+}
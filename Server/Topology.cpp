@@ -0,0 +1,145 @@
+#include "Topology.hpp"
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/socket.h>
+
+using namespace TCPMachine;
+
+Topology Topologies::Spread(size_t nbWorkers)
+{
+	Topology topology;
+
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+	{
+		std::cerr << "[TOPOLOGY] : Could not get the allowed CPUs, threads are not pinned" << std::endl;
+		return topology;
+	}
+
+	// ================== Group the CPUs by node ==================
+	std::map<int, std::vector<int>> nodes;
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (CPU_ISSET(cpu, &allowed))
+			nodes[GetNode(cpu)].push_back(cpu);
+	}
+
+	return Spread(nbWorkers, nodes);
+}
+
+Topology Topologies::Spread(size_t nbWorkers, const std::map<int, std::vector<int>>& nodes)
+{
+	Topology topology;
+	size_t nbCpus = 0;
+
+	for (const auto& node : nodes)
+		nbCpus += node.second.size();
+
+	if (nbCpus == 0)
+		return topology;
+
+	// Nodes without CPU are skipped
+	const int listenerCpu = std::find_if(nodes.begin(), nodes.end(), [](const auto& node) { return not node.second.empty(); })->second.front();
+	topology.listenerCpus.push_back(listenerCpu);
+
+	// ================== One CPU per worker, node after node ==================
+	// Interleaved so a few workers still use the NIC queues & memory of every node
+	std::vector<int> order;
+	bool added = true;
+
+	for (size_t i = 0; added; i++)
+	{
+		added = false;
+
+		for (const auto& node : nodes)
+		{
+			if (i >= node.second.size())
+				continue;
+
+			added = true;
+
+			// The listener keeps its CPU when there is another one for the workers
+			if (node.second[i] != listenerCpu || nbCpus == 1)
+				order.push_back(node.second[i]);
+		}
+	}
+
+	for (size_t i = 0; i < nbWorkers; i++)
+		topology.workerCpus.push_back(order[i % order.size()]);
+
+	topology.followIncomingCpu = true;
+
+	std::cout << "[TOPOLOGY] : " << nodes.size() << " NUMA Nodes, Listener on CPU " << listenerCpu << std::endl;
+	return topology;
+}
+
+int Topologies::PinCurrentThread(const std::vector<int>& cpus)
+{
+	if (cpus.empty())
+		return 0;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	for (int cpu : cpus)
+	{
+		if (cpu >= 0 && cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	}
+
+	int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	if (result != 0)
+	{
+		std::cerr << "[TOPOLOGY] : Could not pin thread: " << std::strerror(result) << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int Topologies::GetNode(int cpu)
+{
+	// The node of a CPU is a nodeN link in its sysfs directory
+	const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+	DIR* dir = opendir(path.c_str());
+
+	if (dir == nullptr)
+		return 0;
+
+	int node = 0;
+
+	for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir))
+	{
+		if (std::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+		{
+			node = std::atoi(entry->d_name + 4);
+			break;
+		}
+	}
+
+	closedir(dir);
+	return node;
+}
+
+int Topologies::GetIncomingCpu(const int fd)
+{
+	int cpu = -1;
+	socklen_t len = sizeof(cpu);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+		return -1;
+
+	return cpu;
+}
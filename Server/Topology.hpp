@@ -0,0 +1,39 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstddef>
+
+namespace TCPMachine {
+
+	// Where the listener & the workers run
+	// Empty sets leave the threads to the scheduler (default)
+	struct Topology {
+		// CPUs the listener may run on
+		std::vector<int> listenerCpus;
+		// CPU of each worker, worker i runs on workerCpus[i % size]
+		std::vector<int> workerCpus;
+		// Queue each accepted socket to the worker on the CPU its packets arrive on (SO_INCOMING_CPU)
+		// so the session runs where the NIC RSS queue delivers. Needs pinned workers
+		bool followIncomingCpu = false;
+	};
+
+	namespace Topologies {
+
+		// Listener on the first allowed CPU, workers spread over the NUMA nodes one CPU each,
+		// wrapping around when there are more workers than CPUs. Follows the incoming CPU
+		Topology Spread(size_t nbWorkers);
+		// Same over the given CPUs of each node, to simulate a NUMA layout on a machine without one
+		Topology Spread(size_t nbWorkers, const std::map<int, std::vector<int>>& nodes);
+
+		// Pin the calling thread to the CPUs, nothing is done for an empty set
+		// Return -1 if the affinity could not be set
+		int PinCurrentThread(const std::vector<int>& cpus);
+
+		// NUMA node of the CPU from sysfs, 0 if unknown
+		int GetNode(int cpu);
+
+		// CPU the packets of the socket arrive on, -1 if unknown
+		int GetIncomingCpu(const int fd);
+	}
+}
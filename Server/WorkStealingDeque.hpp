@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+namespace TCPMachine {
+
+	// Chase-Lev work stealing deque (Le, Pop, Cohen & Zappa Nardelli, PPoPP 2013)
+	// Only the owner thread may Push (bottom), any thread may Steal (top).
+	// The owner takes with Steal too, oldest first, so no Pop from the bottom (LIFO) is kept
+	template <typename T>
+	class WorkStealingDeque {
+
+		static_assert(std::is_trivially_copyable<T>::value, "Items are copied through std::atomic");
+
+	public:
+
+		// Capacity must be a power of 2, the deque grows when full
+		explicit WorkStealingDeque(size_t capacity = 64) : top(0), bottom(0)
+		{
+			garbage.emplace_back(new Array(capacity));
+			array.store(garbage.back().get(), std::memory_order_relaxed);
+		}
+
+		WorkStealingDeque(const WorkStealingDeque&) = delete;
+		WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+		// Owner only
+		void Push(const T item)
+		{
+			int64_t b = bottom.load(std::memory_order_relaxed);
+			int64_t t = top.load(std::memory_order_acquire);
+			Array* a = array.load(std::memory_order_relaxed);
+
+			if (b - t > static_cast<int64_t>(a->capacity) - 1)
+			{
+				// Thieves may still read the old array, it is kept until the deque dies
+				garbage.emplace_back(a->Grow(t, b));
+				a = garbage.back().get();
+				array.store(a, std::memory_order_release);
+			}
+
+			a->Put(b, item);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		// Any thread, return false if the deque is empty or the item was taken by someone else
+		bool Steal(T* item)
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = bottom.load(std::memory_order_acquire);
+
+			if (t >= b)
+				return false;
+
+			Array* a = array.load(std::memory_order_acquire);
+			T x = a->Get(t);
+
+			if (not top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return false;
+
+			*item = x;
+			return true;
+		}
+
+		// Approximate when called from a thief
+		size_t Size() const
+		{
+			int64_t b = bottom.load(std::memory_order_relaxed);
+			int64_t t = top.load(std::memory_order_relaxed);
+
+			return b > t ? static_cast<size_t>(b - t) : 0;
+		}
+
+	private:
+
+		struct Array {
+
+			explicit Array(size_t capacity) : capacity(capacity), items(new std::atomic<T>[capacity]) {}
+
+			const size_t capacity;
+			std::unique_ptr<std::atomic<T>[]> items;
+
+			T Get(int64_t i) const
+			{
+				return items[static_cast<size_t>(i) & (capacity - 1)].load(std::memory_order_relaxed);
+			}
+
+			void Put(int64_t i, T item)
+			{
+				items[static_cast<size_t>(i) & (capacity - 1)].store(item, std::memory_order_relaxed);
+			}
+
+			Array* Grow(int64_t t, int64_t b) const
+			{
+				Array* bigger = new Array(capacity * 2);
+
+				for (int64_t i = t; i < b; i++)
+					bigger->Put(i, Get(i));
+
+				return bigger;
+			}
+		};
+
+		// Thieves & owner on different cache lines
+		alignas(64) std::atomic<int64_t> top;
+		alignas(64) std::atomic<int64_t> bottom;
+		std::atomic<Array*> array;
+
+		// Every array ever used, the last one is the current one (owner only)
+		std::vector<std::unique_ptr<Array>> garbage;
+	};
+}
@@ -1,15 +1,30 @@
 #include <iostream>
 #include <signal.h>
 #include <future>
+#include <cstring>
+#include <cstdlib>
 
 #include "Server.hpp"
 
 #define PORT 14005
 #define WORKERS 2
+// Small automation messages: Nagle off, busy poll, fast open
+#define PROFILE TCPMachine::SocketProfile::LowLatency
+
+// Unix socket used to hand the listener to a new process on SIGUSR2, its directory is made 0700
+#define HANDOFF_PATH "/tmp/tcpmachine/handoff.sock"
+// Time given to active sessions to finish on SIGTERM / SIGUSR2
+#define DRAIN_DEADLINE std::chrono::seconds(30)
+// Max size of a capture file (--capture <path>)
+#define CAPTURE_MAX_BYTES (size_t(1) << 30)
+// Longest --batch budget in us, past it a reply waits long enough to look like a stalled server
+#define MAX_BATCH_BUDGET_US 100000
+// Highest --connections-per-ip, past it the limit no longer limits anything
+#define MAX_CONNECTIONS_PER_IP 100000
 
 #define DEBUG
 
-int main()
+int main(int argc, char** argv)
 {
     std::cout << "[TCPMACHINE] : Creating Signal Handler" << std::endl;
     
@@ -19,18 +34,131 @@ int main()
     sigaddset(&sigset, SIGINT);
     sigaddset(&sigset, SIGTERM);
     sigaddset(&sigset, SIGTRAP); // VS debugger uses SIGTRAP for remote dev
+    sigaddset(&sigset, SIGUSR2); // Hot restart: hand the listener to a new process
+    sigaddset(&sigset, SIGUSR1); // Print the running sessions
     pthread_sigmask(SIG_BLOCK, &sigset, nullptr);
 
-    TCPMachine::Server srv(PORT, WORKERS);
+    // Per client (IP) limits so one bot behind a NAT cannot take all the workers
+    // Connections unlimited unless --connections-per-ip: a NAT or a proxy may open many for its users
+    TCPMachine::RateLimiter::Config limits;
+    limits.messages = { 200, 400, TCPMachine::RateLimiter::Action::Delay };
+    limits.bytes = { 4 * 1024 * 1024, 16 * 1024 * 1024, TCPMachine::RateLimiter::Action::Delay };
+
+    // --connections-per-ip <n>: refuse the connections of an IP over n/s (bursts of 2n), the limiter is built with the server
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--connections-per-ip") != 0)
+            continue;
+
+        char* end = nullptr;
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        const long rate = std::strtol(value, &end, 10);
+
+        if (end == value || *end != '\0' || rate < 1 || rate > MAX_CONNECTIONS_PER_IP)
+        {
+            std::cerr << "[TCPMACHINE] : --connections-per-ip expects a rate from 1 to " << MAX_CONNECTIONS_PER_IP << " per second, got \"" << value << "\"" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        limits.connections = { static_cast<double>(rate), 2.0 * rate, TCPMachine::RateLimiter::Action::Reject };
+    }
+
+    TCPMachine::Server srv(PORT, WORKERS, limits, PROFILE);
+
+    for (int i = 1; i < argc; i++)
+    {
+        // --takeover: reuse the listener of the running server instead of binding
+        if (std::strcmp(argv[i], "--takeover") == 0)
+        {
+            std::cout << "[TCPMACHINE] : Taking over the running server on " << HANDOFF_PATH << std::endl;
+
+            if (srv.TakeOver(HANDOFF_PATH, DRAIN_DEADLINE) < 0)
+            {
+                std::cerr << "[TCPMACHINE] : Take over failed" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        // --pin: pin the listener & the workers spread over the NUMA nodes
+        else if (std::strcmp(argv[i], "--pin") == 0)
+        {
+            if (srv.SetTopology(TCPMachine::Topologies::Spread(WORKERS)) < 0)
+            {
+                std::cerr << "[TCPMACHINE] : Could not set the topology" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        // --batch <us>: coalesce the small writes of a session for up to <us> microseconds
+        else if (std::strcmp(argv[i], "--batch") == 0)
+        {
+            char* end = nullptr;
+            const char* value = i + 1 < argc ? argv[++i] : "";
+            const long budget = std::strtol(value, &end, 10);
+
+            // strtoul would take "-1" as a huge budget and "abc" as 0
+            if (end == value || *end != '\0' || budget < 1 || budget > MAX_BATCH_BUDGET_US)
+            {
+                std::cerr << "[TCPMACHINE] : --batch expects a budget from 1 to " << MAX_BATCH_BUDGET_US << " us, got \"" << value << "\"" << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            TCPMachine::Session::Batching batching;
+            batching.budget = std::chrono::microseconds(budget);
+
+            if (srv.SetBatching(batching) < 0)
+            {
+                std::cerr << "[TCPMACHINE] : Could not set the batching" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        // Parsed before the server was built
+        else if (std::strcmp(argv[i], "--connections-per-ip") == 0)
+        {
+            i++;
+        }
+        // --capture <path>: record the sessions for the Replay tool
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            if (srv.StartCapture(argv[++i], CAPTURE_MAX_BYTES) < 0)
+            {
+                std::cerr << "[TCPMACHINE] : Capture failed" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
 
     auto signal_handler = [&srv, &sigset]() 
     {
         int signum = 0;
         // wait until a signal is delivered:
         sigwait(&sigset, &signum);
+
+        // SIGUSR1: list the sessions and keep waiting
+        while (signum == SIGUSR1)
+        {
+            auto sessions = srv.ListSessions();
+            std::cout << "[TCPMACHINE] : " << sessions.size() << " Running Sessions" << std::endl;
+
+            for (const auto& info : sessions)
+            {
+                char peer[TCPMachine::Endpoint::FORMAT_MAX];
+                info.peer.Format(peer, sizeof(peer));
+
+                std::cout << "  #" << info.id << " " << peer << " in: " << info.bytesIn << "B out: " << info.bytesOut
+                    << "B age: " << info.age.count() << "ms idle: " << info.idle.count() << "ms batches: " << info.batches
+                    << " (" << info.batchedWrites << " writes, " << info.batchedBytes << "B)" << std::endl;
+            }
+
+            sigwait(&sigset, &signum);
+        }
        
         // Stop the server when the signal is delivred
-        srv.Stop();
+        // SIGTERM: drain for deploys, SIGUSR2: hot restart, others: stop now
+        if (signum == SIGTERM)
+            srv.Drain(DRAIN_DEADLINE);
+        else if (signum == SIGUSR2)
+            srv.HandOffListener(HANDOFF_PATH, DRAIN_DEADLINE);
+        else
+            srv.Stop();
       
         return signum;
     };
@@ -40,7 +168,7 @@ int main()
     // Main + Server Listener + SigHandler + X Worker = WORKERS + 3
     std::cout << "[TCPMACHINE] : Using a total of: " << (WORKERS + 3) << " Threads" << std::endl;  
     std::cout << "[TCPMACHINE] : Handler is Ready, Starting Server..." << std::endl;
-    std::cout << "[TCPMACHINE] : Waiting for SIGTERM or SIGINT ([CTRL]+[c])" << std::endl;
+    std::cout << "[TCPMACHINE] : Waiting for SIGTERM (drain), SIGUSR2 (hot restart) or SIGINT ([CTRL]+[c]), SIGUSR1 lists the sessions" << std::endl;
     
     srv.Start();   
 